@@ -0,0 +1,38 @@
+#ifndef _SYS_MMAN_H_
+#define _SYS_MMAN_H_
+
+/*
+ * Get the PROT_ and MAP_ #defines from the kernel
+ */
+#include <kern/mman.h>
+
+/* Returned by mmap on failure */
+#define MAP_FAILED ((void *)-1)
+
+/*
+ * Map LENGTH bytes of the file PATH, starting at OFFSET (which must
+ * be a multiple of the page size), at an address the kernel picks.
+ * Pages are read from the file when first touched. With MAP_SHARED,
+ * changes are written back to the file when the mapping is removed
+ * (by munmap or when the process exits); with MAP_PRIVATE they are
+ * never seen by anyone else.
+ *
+ * This takes a pathname where other systems take a file handle.
+ *
+ * munmap removes a whole mapping; ADDR and LENGTH must be what mmap
+ * returned and was given.
+ */
+void *mmap(const char *path, size_t length, int prot, int flags, off_t offset);
+int munmap(void *addr, size_t length);
+
+/*
+ * Tell the kernel how the LENGTH bytes at ADDR (page-aligned; heap,
+ * stack or mmap'd memory) are going to be used. MADV_RANDOM and
+ * MADV_SEQUENTIAL set how far file faults read ahead, for the whole
+ * region the range is in. MADV_WILLNEED brings the pages in now.
+ * MADV_DONTNEED frees them now, without moving the break; they read
+ * back as zeros (file mappings: as the file has them).
+ */
+int madvise(void *addr, size_t length, int advice);
+
+#endif /* _SYS_MMAN_H_ */
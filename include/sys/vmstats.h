@@ -0,0 +1,15 @@
+#ifndef _SYS_VMSTATS_H_
+#define _SYS_VMSTATS_H_
+
+/*
+ * Get struct vmstats and the VMSTATS_ #defines from the kernel
+ */
+#include <kern/vmstats.h>
+
+/*
+ * Copy the VM counters of the calling process (VMSTATS_SELF) or of the
+ * whole system (VMSTATS_GLOBAL) into BUF.
+ */
+int getvmstats(int which, struct vmstats *buf);
+
+#endif /* _SYS_VMSTATS_H_ */
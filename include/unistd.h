@@ -10,6 +10,7 @@
  */
 #include <kern/unistd.h>
 #include <kern/ioctl.h>
+#include <kern/time.h>
 
 
 /*
@@ -119,6 +120,7 @@ int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 int __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -55,6 +55,21 @@ int spl0(void);
 int splx(int);
 
 void cpu_idle(void);
+
+/*
+ * cpu_pollintr() is cpu_idle() without the waiting: it takes any
+ * interrupt that is already pending and returns.
+ */
+void cpu_pollintr(void);
+
+/*
+ * Interrupts-off time measurement (see spl.c). spl_maxoff_usecs is the
+ * longest time interrupts stayed off since spl_measure_start().
+ */
+extern int spl_measuring;
+extern u_int32_t spl_maxoff_usecs;
+void spl_measure_start(void);
+void spl_measure_stop(void);
 void cpu_halt(void);
 
 /*
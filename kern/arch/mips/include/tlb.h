@@ -31,13 +31,24 @@ void TLB_Write(u_int32_t entryhi, u_int32_t entrylo, u_int32_t index);
 void TLB_Read(u_int32_t *entryhi, u_int32_t *entrylo, u_int32_t index);
 int TLB_Probe(u_int32_t entryhi, u_int32_t entrylo);
 
+/*
+ *   TLB_SetPID: load the address space ID the processor matches
+ *        entries against (the PID field of c0_entryhi).
+ *
+ *        IMPORTANT NOTE: the other functions above all leave c0_entryhi
+ *        holding whatever entry they were passed or read, so the
+ *        current ID must be set again after using them.
+ */
+void TLB_SetPID(u_int32_t pid);
+
 /*
  * TLB entry fields.
  *
- * Note that the MIPS has support for a 6-bit address space ID. In the
- * interests of simplicity, we don't use it. The fields related to it
- * (TLBLO_GLOBAL and TLBHI_PID) can be left always zero, as can the
- * bits that aren't assigned a meaning.
+ * Note that the MIPS has support for a 6-bit address space ID. User
+ * entries are tagged with the ID of their address space (TLBHI_PID) so
+ * they survive context switches; see vm.c. TLBLO_GLOBAL is only used
+ * for kernel mappings in kseg2 (see vmalloc.h), and bits that aren't
+ * assigned a meaning are left zero.
  *
  * The TLBLO_DIRTY bit is actually a write privilege bit - it is not
  * ever set by the processor. If you set it, writes are permitted. If
@@ -49,14 +60,15 @@ int TLB_Probe(u_int32_t entryhi, u_int32_t entrylo);
 
 /* Fields in the high-order word */
 #define TLBHI_VPAGE   0xfffff000
-/*      TLBHI_PID     0x00000fc0 */
+#define TLBHI_PID     0x00000fc0
+#define TLBHI_PIDSHIFT 6
 
 /* Fields in the low-order word */
 #define TLBLO_PPAGE   0xfffff000
 #define TLBLO_NOCACHE 0x00000800
 #define TLBLO_DIRTY   0x00000400
 #define TLBLO_VALID   0x00000200
-/*      TLBLO_GLOBAL  0x00000100 */
+#define TLBLO_GLOBAL  0x00000100
 
 /*
  * Values for completely invalid TLB entries. The TLB entry index should
@@ -72,5 +84,11 @@ int TLB_Probe(u_int32_t entryhi, u_int32_t entrylo);
 
 #define NUM_TLB  64
 
+/*
+ * Number of distinct address space IDs.
+ */
+
+#define NUM_ASID 64
+
 
 #endif /* _MACHINE_TLB_H_ */
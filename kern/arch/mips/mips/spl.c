@@ -2,6 +2,7 @@
 #include <lib.h>
 #include <machine/spl.h>
 #include <machine/specialreg.h>
+#include <clock.h>
 
 /*
  * Actual interrupt on/off functions.
@@ -63,6 +64,63 @@ interrupts_onoff(void)
 /* System starts out with interrupts off. */
 int curspl = SPL_HIGH;
 
+/*
+ * Interrupts-off time measurement.
+ *
+ * While spl_measuring is set, splx timestamps every change from
+ * interrupts on to interrupts off and back, and remembers the longest
+ * stretch with them off. A thread that sleeps with interrupts off is
+ * charged until whoever runs next turns them back on, which is the
+ * time the processor actually spent unable to take an interrupt.
+ *
+ * The clock is a device, so it can only be read once devices are
+ * attached; measuring is turned on from the kernel menu.
+ */
+int spl_measuring = 0;
+u_int32_t spl_maxoff_usecs = 0;
+static time_t spl_offsecs;
+static u_int32_t spl_offnsecs;
+static int spl_offstamped = 0;
+
+static
+void
+spl_measure(int oldspl, int newspl)
+{
+	time_t secs;
+	u_int32_t nsecs, usecs;
+
+	if (oldspl==0 && newspl>0) {
+		gettime(&spl_offsecs, &spl_offnsecs);
+		spl_offstamped = 1;
+	}
+	else if (oldspl>0 && newspl==0 && spl_offstamped) {
+		gettime(&secs, &nsecs);
+		usecs = getinterval_usecs(spl_offsecs, spl_offnsecs, secs, nsecs);
+		if (usecs > spl_maxoff_usecs) {
+			spl_maxoff_usecs = usecs;
+		}
+		spl_offstamped = 0;
+	}
+}
+
+/* Start (or restart) measuring interrupts-off time. */
+void
+spl_measure_start(void)
+{
+	int spl = splhigh();
+	spl_maxoff_usecs = 0;
+	spl_offstamped = 0;
+	spl_measuring = 1;
+	splx(spl);
+}
+
+/* Stop measuring. */
+void
+spl_measure_stop(void)
+{
+	spl_measuring = 0;
+}
+
 /* Set the spl level. */
 int
 splx(int newspl)
@@ -97,7 +155,17 @@ splx(int newspl)
 	if (newspl>0) {
 		interrupts_off();
 	}
-	else if (newspl==0) {
+
+	/*
+	 * Timestamp with interrupts off either way: just after they go
+	 * off, or just before they come back on. (gettime does not
+	 * come back here.)
+	 */
+	if (spl_measuring) {
+		spl_measure(curspl, newspl);
+	}
+
+	if (newspl==0) {
 		interrupts_on();
 	}
 
@@ -149,10 +217,42 @@ cpu_idle(void)
 	 * bit pattern for the wait instruction as a long instead.
 	 */
 
+	/*
+	 * Waiting here does not delay any interrupt (one arriving ends
+	 * the wait), so it does not count as interrupts-off time.
+	 */
+	if (spl_measuring) {
+		spl_measure(curspl, 0);
+	}
+
 	/* __asm volatile("wait"); */
 	__asm volatile(".long 0x42000020");
 
 	interrupts_onoff();
+
+	if (spl_measuring) {
+		spl_measure(0, curspl);
+	}
+}
+
+/*
+ * Take any interrupt that is pending, without waiting for one. For
+ * idle-loop work done a piece at a time with interrupts off.
+ */
+void
+cpu_pollintr(void)
+{
+	assert(curspl>0);
+
+	if (spl_measuring) {
+		spl_measure(curspl, 0);
+	}
+
+	interrupts_onoff();
+
+	if (spl_measuring) {
+		spl_measure(0, curspl);
+	}
 }
 
 /*
@@ -35,9 +35,9 @@
  * return code will restart the "syscall" instruction and the system
  * call will repeat forever.
  *
- * Since none of the OS/161 system calls have more than 4 arguments,
- * there should be no need to fetch additional arguments from the
- * user-level stack.
+ * Arguments past the fourth are on the user-level stack, after the
+ * 16 bytes the caller reserves there for the first four. Only mmap
+ * has one (its offset); sys_mmap copies it in from tf_sp+16.
  *
  * Watch out: if you make system calls that have 64-bit quantities as
  * arguments, they will get passed in pairs of registers, and not
@@ -131,6 +131,28 @@ mips_syscall(struct trapframe *tf)
 		case SYS_sbrk:
 		err = sys_sbrk(tf->tf_a0, &retval);
 		break;
+
+		case SYS_mmap:
+		err = sys_mmap((const char *)tf->tf_a0, tf->tf_a1, tf->tf_a2, tf->tf_a3,
+			       (userptr_t)(tf->tf_sp + 16), &retval);
+		break;
+
+		case SYS_munmap:
+		err = sys_munmap(tf->tf_a0, tf->tf_a1);
+		break;
+
+		case SYS_getvmstats:
+		err = sys_getvmstats(tf->tf_a0, (struct vmstats *)tf->tf_a1);
+		break;
+
+		case SYS_madvise:
+		err = sys_madvise(tf->tf_a0, tf->tf_a1, tf->tf_a2);
+		break;
+
+		case SYS_nanosleep:
+		err = sys_nanosleep((const struct timespec *)tf->tf_a0,
+				    (struct timespec *)tf->tf_a1);
+		break;
  
 	    default:
 		kprintf("Unknown syscall %d\n", callno);
@@ -187,7 +209,7 @@ void md_forkentry(trapframeptr tf, unsigned long addrspace) {
 	
 	// Create a new trapframe in a user-accessible space and set it to child's TF (shalow copy okay since no ptrs in TF)
 	Trapframe newTF = *(tf);
-	kfree(tf); //avoid mem leak
+	kcache_free(trapframe_cache, tf); //avoid mem leak
 
 	//Go to user mode (should not return)
 	mips_usermode(&newTF);
@@ -374,6 +374,11 @@ thread.o: ${S}/thread/thread.c
 SRCS+=${S}/thread/thread.c
 OBJS+=thread.o
 
+timer.o: ${S}/thread/timer.c
+	${COMPILE.c} ${S}/thread/timer.c
+SRCS+=${S}/thread/timer.c
+OBJS+=timer.o
+
 hello.o: ${S}/main/hello.c
 	${COMPILE.c} ${S}/main/hello.c
 SRCS+=${S}/main/hello.c
@@ -394,6 +399,11 @@ oursyscall.o: ${S}/userprog/oursyscall.c
 SRCS+=${S}/userprog/oursyscall.c
 OBJS+=oursyscall.o
 
+pid.o: ${S}/userprog/pid.c
+	${COMPILE.c} ${S}/userprog/pid.c
+SRCS+=${S}/userprog/pid.c
+OBJS+=pid.o
+
 loadelf.o: ${S}/userprog/loadelf.c
 	${COMPILE.c} ${S}/userprog/loadelf.c
 SRCS+=${S}/userprog/loadelf.c
@@ -414,6 +424,31 @@ vm.o: ${S}/vm/vm.c
 SRCS+=${S}/vm/vm.c
 OBJS+=vm.o
 
+pagetable.o: ${S}/vm/pagetable.c
+	${COMPILE.c} ${S}/vm/pagetable.c
+SRCS+=${S}/vm/pagetable.c
+OBJS+=pagetable.o
+
+swap.o: ${S}/vm/swap.c
+	${COMPILE.c} ${S}/vm/swap.c
+SRCS+=${S}/vm/swap.c
+OBJS+=swap.o
+
+pagecache.o: ${S}/vm/pagecache.c
+	${COMPILE.c} ${S}/vm/pagecache.c
+SRCS+=${S}/vm/pagecache.c
+OBJS+=pagecache.o
+
+ksm.o: ${S}/vm/ksm.c
+	${COMPILE.c} ${S}/vm/ksm.c
+SRCS+=${S}/vm/ksm.c
+OBJS+=ksm.o
+
+vmalloc.o: ${S}/vm/vmalloc.c
+	${COMPILE.c} ${S}/vm/vmalloc.c
+SRCS+=${S}/vm/vmalloc.c
+OBJS+=vmalloc.o
+
 arraytest.o: ${S}/test/arraytest.c
 	${COMPILE.c} ${S}/test/arraytest.c
 SRCS+=${S}/test/arraytest.c
@@ -454,6 +489,11 @@ fstest.o: ${S}/test/fstest.c
 SRCS+=${S}/test/fstest.c
 OBJS+=fstest.o
 
+vmtest.o: ${S}/test/vmtest.c
+	${COMPILE.c} ${S}/test/vmtest.c
+SRCS+=${S}/test/vmtest.c
+OBJS+=vmtest.o
+
 autoconf.o: ${S}/compile/ASST3/autoconf.c
 	${COMPILE.c} ${S}/compile/ASST3/autoconf.c
 SRCS+=${S}/compile/ASST3/autoconf.c
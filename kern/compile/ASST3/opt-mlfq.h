@@ -0,0 +1,5 @@
+/* Automatically generated; do not edit */
+#ifndef _OPT_MLFQ_H_
+#define _OPT_MLFQ_H_
+#define OPT_MLFQ 1
+#endif /* _OPT_MLFQ_H_ */
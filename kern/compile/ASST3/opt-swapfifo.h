@@ -0,0 +1,5 @@
+/* Automatically generated; do not edit */
+#ifndef _OPT_SWAPFIFO_H_
+#define _OPT_SWAPFIFO_H_
+#define OPT_SWAPFIFO 0
+#endif /* _OPT_SWAPFIFO_H_ */
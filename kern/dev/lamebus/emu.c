@@ -673,6 +673,17 @@ emufs_fsync(struct vnode *v)
 	return 0;
 }
 
+/*
+ * VOP_MMAP
+ */
+static
+int
+emufs_mmap(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
 /*
  * VOP_TRUNCATE
  */
@@ -853,7 +864,7 @@ static const struct vnode_ops emufs_fileops = {
 	emufs_file_gettype,
 	emufs_tryseek,
 	emufs_fsync,
-	UNIMP,   /* mmap */
+	emufs_mmap,
 	emufs_truncate,
 	NOTDIR,  /* namefile */
 
@@ -22,6 +22,23 @@
 
 static int haveclock=0;
 
+/*
+ * Program the countdown timer to go off after USECS, and again every
+ * USECS after that if PERIODIC is set. Called by the hardclock code,
+ * which stops the periodic tick when the system has nothing to
+ * preempt.
+ */
+static
+void
+ltimer_settimer(void *vlt, int periodic, u_int32_t usecs)
+{
+	struct ltimer_softc *lt = vlt;
+
+	bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE,
+			   periodic ? 1 : 0);
+	bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT, usecs);
+}
+
 /*
  * Setup routine called by autoconf stuff when an ltimer is found.
  */
@@ -37,14 +54,12 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 		lt->lt_hardclock = 1;
 
 		/*
-		 * Arm the timer to go off HZ times a second, and set
-		 * it to autoreload (so we don't need to pay any more
-		 * attention to it)
+		 * Hand the timer to the hardclock code, which arms it
+		 * to go off HZ times a second with autoreload, and
+		 * switches it to one-shot wakeups when nothing needs
+		 * the tick.
 		 */
-
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 1);
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT,
-				   LT_GRANULARITY/HZ);
+		hardclock_attach(lt, ltimer_settimer, ltimer_gettime);
 
 		kprintf("\nhardclock on ltimer%d (%u hz)", ltimerno, HZ);
 	}
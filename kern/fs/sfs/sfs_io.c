@@ -4,6 +4,10 @@
 #include <uio.h>
 #include <sfs.h>
 #include <dev.h>
+#include <timer.h>
+
+/* Longest wait between retries of a block that got an I/O error. */
+#define SFS_RETRY_MAXMS  1000
 
 ////////////////////////////////////////////////////////////
 //
@@ -42,6 +46,15 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 			goto retry;
 		}
 		else if (tries < 10) {
+			/*
+			 * Back off before trying again: 20ms, 40ms, ...,
+			 * up to SFS_RETRY_MAXMS.
+			 */
+			u_int32_t msecs = 10 << tries;
+			if (msecs > SFS_RETRY_MAXMS) {
+				msecs = SFS_RETRY_MAXMS;
+			}
+			timer_sleep(timer_ms2ticks(msecs));
 			tries++;
 			goto retry;
 		}
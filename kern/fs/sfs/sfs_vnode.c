@@ -20,6 +20,9 @@ static int
 sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int type,
 		 struct sfs_vnode **ret);
 
+/* In-memory vnodes (of every mounted sfs) come from this object cache */
+static struct kcache *sfs_vnode_cache;
+
 ////////////////////////////////////////////////////////////
 //
 // Simple stuff
@@ -917,7 +920,7 @@ sfs_reclaim(struct vnode *v)
 	VOP_KILL(&sv->sv_v);
 
 	/* Release the storage for the vnode structure itself. */
-	kfree(sv);
+	kcache_free(sfs_vnode_cache, sv);
 
 	/* Done */
 	return 0;
@@ -1047,14 +1050,15 @@ sfs_fsync(struct vnode *v)
 }
 
 /*
- * Called for mmap().
+ * Called for mmap(). Any file can be mapped; the VM system does the
+ * rest through sfs_read and sfs_write.
  */
 static
 int
 sfs_mmap(struct vnode *v   /* add stuff as needed */)
 {
 	(void)v;
-	return EUNIMP;
+	return 0;
 }
 
 /*
@@ -1579,7 +1583,7 @@ sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int forcetype,
 
 	/* Didn't have it loaded; load it */
 
-	sv = kmalloc(sizeof(struct sfs_vnode));
+	sv = kcache_alloc(sfs_vnode_cache);
 	if (sv==NULL) {
 		return ENOMEM;
 	}
@@ -1593,7 +1597,7 @@ sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int forcetype,
 	/* Read the block the inode is in */
 	result = sfs_rblock(sfs, &sv->sv_i, ino);
 	if (result) {
-		kfree(sv);
+		kcache_free(sfs_vnode_cache, sv);
 		return result;
 	}
 
@@ -1630,7 +1634,7 @@ sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = VOP_INIT(&sv->sv_v, ops, &sfs->sfs_absfs, sv);
 	if (result) {
-		kfree(sv);
+		kcache_free(sfs_vnode_cache, sv);
 		return result;
 	}
 
@@ -1641,7 +1645,7 @@ sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int forcetype,
 	result = array_add(sfs->sfs_vnodes, sv);
 	if (result) {
 		VOP_KILL(&sv->sv_v);
-		kfree(sv);
+		kcache_free(sfs_vnode_cache, sv);
 		return result;
 	}
 
@@ -1668,3 +1672,16 @@ sfs_getroot(struct fs *fs)
 
 	return &sv->sv_v;
 }
+
+/*
+ * Create the object cache in-memory vnodes come from.
+ */
+void
+sfs_bootstrap(void)
+{
+	sfs_vnode_cache = kcache_create("sfs_vnode",
+					sizeof(struct sfs_vnode), NULL);
+	if (sfs_vnode_cache==NULL) {
+		panic("sfs_bootstrap: cannot create vnode cache\n");
+	}
+}
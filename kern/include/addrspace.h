@@ -2,6 +2,8 @@
 #define _ADDRSPACE_H_
 
 #include <vm.h>
+#include <pagetable.h>
+#include <kern/mman.h>
 #include "opt-dumbvm.h"
 
 struct vnode;
@@ -20,25 +22,43 @@ struct vnode;
 #define STACKLIMIT 1052672
 #define HEAPLIMIT 1052672
 
-//We need a page table, for simplicity we can make it a linked list
-typedef struct pageTableEntry {
-	vaddr_t vaddr; //virtual address reference
-	paddr_t paddr; //physical address referenced by vaddr
-	struct pageTableEntry* next;
-} PageTableEntry;
-typedef PageTableEntry* PageTable;
+//File-backed faults read a cluster of neighbouring pages at once. The cluster doubles while a region is
+//faulted in sequentially and halves when the faults jump around.
+#define CLUSTER_MIN 1
+#define CLUSTER_START 4
+#define CLUSTER_MAX 16
+
+//Region permissions (same bits as the ELF PF_ flags)
+#define REGION_EXEC  0x1
+#define REGION_WRITE 0x2
+#define REGION_READ  0x4
+
+//Regions table starts with room for this many and doubles when it fills up
+#define REGIONS_START 4
 
 //Set up a structure to manage information on the different regions
 typedef struct region {
 	//Virtual base and mapping to physical space
 	vaddr_t vbase;
 	vaddr_t vend; //NOTE: vend will be unused for stack (only use the base)
-	PageTable localPageTable;
 	off_t offset;
 	size_t filesize;
 	int is_executable;
+	//REGION_* bits
+	int perms;
+	//File the pages are read from (offset and filesize are within it), or NULL for anonymous memory
+	struct vnode* v;
+	//Changes are written back to the file (mmap MAP_SHARED) instead of staying private
+	int shared;
+	//Whole file pages are shared through the page cache and copied on write (text, mmap MAP_PRIVATE)
+	int cached;
 	//Number of pages in the region
 	int numPages;
+	//Fault-around state: pages to read on the next fault and where a sequential fault would land
+	int cluster;
+	vaddr_t nextFault;
+	//Access hint from madvise (MADV_NORMAL, MADV_RANDOM or MADV_SEQUENTIAL)
+	int advice;
 
 } Region;
 
@@ -53,20 +73,33 @@ struct addrspace {
 	paddr_t as_stackpbase;
 #else
 	/* Put stuff here for your VM system */\
-	//Regions for this process
-	// We guarantee that the first two regions will be text/data
-	Region region1;
-	Region region2;
+	//Regions for this process other than the heap and stack (text, data and any other segments),
+	//sorted by base address so vm_fault can binary search them. They never overlap.
+	Region** regions;
+	int numRegions;
+	int maxRegions;
 
 	//Heap Region
 	Region heap;
-	struct vnode* v;
 
 	//temp for testing purposes
 	//paddr_t as_stackpbase;
 
 	//Stack Region
 	Region stack; //NOTE: vend will be unused for stack (only use the base)
+
+	//Page table covering every region (see pagetable.h)
+	PageTable* pagetable;
+
+	//TLB address space ID, only valid while asidGeneration matches vm.c's (0 = never had one)
+	int asid;
+	unsigned int asidGeneration;
+
+	//VM counters for this address space (see VMSTAT_INC in vm.h)
+	struct vmstats stats;
+
+	//Every address space, for as_retrack
+	struct addrspace* nextas;
 #endif
 };
 
@@ -93,6 +126,33 @@ struct addrspace {
  *    as_define_region - set up a region of memory within the address
  *                space.
  *
+ *    as_findregion - find the region (other than heap and stack)
+ *                containing VADDR, or NULL if there is none. Takes
+ *                time logarithmic in the number of regions.
+ *
+ *    as_define_mapping - set up a region of SZ bytes backed by the
+ *                file V from OFFSET (FILESIZE bytes of it; the rest
+ *                reads as zeros) for mmap. The address is picked from
+ *                the space between the heap's and the stack's limits
+ *                and handed back in RET.
+ *
+ *    as_syncregion - write the changed pages of a shared file region
+ *                back to the file.
+ *
+ *    as_removeregion - write back (if shared), unmap and free a
+ *                region.
+ *
+ *    as_regionof - like as_findregion, but the heap and the stack
+ *                count too.
+ *
+ *    as_discard - unmap the pages of REGION in [START, END) and free
+ *                their frames and swap slots. The region stays; the
+ *                pages fault back in as if never touched.
+ *
+ *    as_retrack - look through every address space for pages whose
+ *                frame swap_unshared flagged and hand them back to
+ *                swap_track. Interrupts must be off.
+ *
  *    as_prepare_load - this is called before actually loading from an
  *                executable into the address space.
  *
@@ -114,10 +174,40 @@ int               as_define_region(struct addrspace *as,
 				   int readable, 
 				   int writeable,
 				   int executable);
+Region*           as_findregion(struct addrspace *as, vaddr_t vaddr);
+int               as_define_mapping(struct addrspace *as, struct vnode *v,
+				    off_t offset, size_t filesize, size_t sz,
+				    int perms, int shared, vaddr_t *ret);
+int               as_syncregion(struct addrspace *as, Region *region);
+int               as_removeregion(struct addrspace *as, Region *region);
+Region*           as_regionof(struct addrspace *as, vaddr_t vaddr);
+void              as_discard(struct addrspace *as, Region *region,
+			     vaddr_t start, vaddr_t end);
+void              as_retrack(void);
 int		  as_prepare_load(struct addrspace *as);
 int		  as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 
+/*
+ * Functions in vm.c
+ *    createEntry - allocate a frame for FAULTADDRESS, map it in
+ *                AS's page table and charge it to CURRREGION, handing
+ *                back its physical address through RET. Returns ENOMEM,
+ *                or EAGAIN if FAULTADDRESS turned out to be mapped (or
+ *                paged out) already. The frame is busy until the caller
+ *                fills it and calls userPageReady.
+ *    createAnonEntry - the same, with a frame that is already zeroed.
+ *    vm_prefetch - bring the pages of REGION in [START, END) into
+ *                memory ahead of use: paged-out pages are read back and
+ *                file pages are read in (with fault-around). Anonymous
+ *                pages nobody has touched are left to fault as zeros.
+ *                Returns an error code.
+ */
+
+int     createEntry(struct addrspace *as, Region *currRegion, vaddr_t faultaddress, paddr_t *ret);
+int     createAnonEntry(struct addrspace *as, Region *currRegion, vaddr_t faultaddress, paddr_t *ret);
+int     vm_prefetch(struct addrspace *as, Region *region, vaddr_t start, vaddr_t end);
+
 /*
  * Functions in loadelf.c
  *    load_elf - load an ELF user program executable into the current
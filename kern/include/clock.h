@@ -9,6 +9,8 @@
  * hardclock() is called from the timer interrupt HZ times a second.
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
+ * getinterval_usecs() is the same in microseconds, for intervals
+ * shorter than about an hour.
  */
 
 /* hardclocks per second */
@@ -22,10 +24,43 @@
 
 void hardclock(void);
 
+/*
+ * Tickless operation.
+ *
+ * The timer that drives hardclock registers with hardclock_attach,
+ * passing SETTIMER, which programs it to fire every USECS (PERIODIC
+ * set) or once after USECS, and GETTIME, which reads its clock.
+ *
+ * When nothing needs to be preempted (the system is idle or only one
+ * thread is runnable) the scheduler calls clock_stoptick, and the timer
+ * is only set to go off for the next lbolt. clock_starttick goes back
+ * to HZ ticks a second and catches up on the ticks that were skipped.
+ * Both are cheap no-ops when already in that state or when
+ * clock_tickless is off. Interrupts must be off.
+ */
+void hardclock_attach(void *dev,
+		      void (*settimer)(void *dev, int periodic, u_int32_t usecs),
+		      void (*gettime)(void *dev, time_t *secs, u_int32_t *nsecs));
+void clock_stoptick(void);
+void clock_starttick(void);
+void clock_printstats(void);
+
+/*
+ * For the timer code (timer.h): clock_sync brings the tick count up to
+ * date if the tick is stopped, and clock_rearm resets the one-shot
+ * after a timer is added. Interrupts must be off.
+ */
+void clock_sync(void);
+void clock_rearm(void);
+
+extern int clock_tickless;
+
 void gettime(time_t *seconds, u_int32_t *nanoseconds);
 
 void getinterval(time_t secs1, u_int32_t nsecs,
 		 time_t secs2, u_int32_t nsecs2,
 		 time_t *rsecs, u_int32_t *rnsecs);
+u_int32_t getinterval_usecs(time_t secs1, u_int32_t nsecs1,
+			    time_t secs2, u_int32_t nsecs2);
 
 #endif /* _CLOCK_H_ */
@@ -40,6 +40,11 @@
 #define SYS___getcwd     29
 #define SYS_stat         30
 #define SYS_lstat        31
+#define SYS_mmap         32
+#define SYS_munmap       33
+#define SYS_getvmstats   34
+#define SYS_madvise      35
+#define SYS_nanosleep    36
 /*CALLEND*/
 
 
@@ -0,0 +1,25 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Definitions for mmap() and madvise().
+ */
+
+/* Protection (the PROT argument) */
+#define PROT_NONE     0x0      /* Pages may not be accessed */
+#define PROT_READ     0x1      /* Pages may be read */
+#define PROT_WRITE    0x2      /* Pages may be written */
+#define PROT_EXEC     0x4      /* Pages may be executed */
+
+/* Mapping type (the FLAGS argument; exactly one is required) */
+#define MAP_SHARED    0x1      /* Writes go back to the file */
+#define MAP_PRIVATE   0x2      /* Writes are private copies */
+
+/* Access hints (the ADVICE argument of madvise) */
+#define MADV_NORMAL     0      /* No hint; fault-around adapts to the access pattern */
+#define MADV_RANDOM     1      /* Read only the faulting page */
+#define MADV_SEQUENTIAL 2      /* Read ahead as far as possible, page out soon after use */
+#define MADV_WILLNEED   3      /* Bring the pages in now */
+#define MADV_DONTNEED   4      /* Free the pages now; they read back as zeros (or from the file) */
+
+#endif /* _KERN_MMAN_H_ */
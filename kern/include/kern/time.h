@@ -0,0 +1,12 @@
+#ifndef _KERN_TIME_H_
+#define _KERN_TIME_H_
+
+/*
+ * Time intervals, for nanosleep().
+ */
+struct timespec {
+	time_t tv_sec;		/* seconds */
+	long   tv_nsec;		/* nanoseconds, 0 to 999999999 */
+};
+
+#endif /* _KERN_TIME_H_ */
@@ -0,0 +1,29 @@
+#ifndef _KERN_VMSTATS_H_
+#define _KERN_VMSTATS_H_
+
+/*
+ * Structure for getvmstats (call to get virtual memory counters)
+ */
+
+struct vmstats {
+	u_int32_t vs_faults_read;	/* TLB misses on loads */
+	u_int32_t vs_faults_write;	/* TLB misses on stores */
+	u_int32_t vs_faults_readonly;	/* stores to read-only pages */
+	u_int32_t vs_pagealloc;		/* frames allocated for user pages */
+	u_int32_t vs_pagefree;		/* user pages unmapped and released */
+	u_int32_t vs_fileins;		/* pages read in from files */
+	u_int32_t vs_swapins;		/* pages read back from swap */
+	u_int32_t vs_swapouts;		/* pages written out to swap */
+	u_int32_t vs_zerofills;		/* zeroed pages handed out */
+	u_int32_t vs_forkshared;	/* pages shared by fork */
+	u_int32_t vs_cowcopies;		/* shared pages copied on write */
+};
+
+/*
+ * Which counters getvmstats returns.
+ */
+
+#define VMSTATS_SELF    0	/* the calling process */
+#define VMSTATS_GLOBAL  1	/* everything since boot */
+
+#endif /* _KERN_VMSTATS_H_ */
@@ -0,0 +1,51 @@
+#ifndef _KSM_H_
+#define _KSM_H_
+
+#include <vm.h>
+
+/*
+ * Samepage merging for anonymous memory.
+ *
+ * Children forked from the same parent (and programs run over and over
+ * from the shell) end up with many private pages holding exactly the
+ * same bytes. When there is nothing else to do, the idle loop walks the
+ * coremap a few pages at a time and hashes every private user page.
+ * A page of zeros is folded into the shared zero page; any other page
+ * whose contents match a page seen before (compared byte for byte, the
+ * hash only narrows the search) is remapped to that one frame and its
+ * own frame freed. Merged pages are mapped read-only with PTE_COW, so
+ * the first write to one gets a private copy again through vm_fault.
+ *
+ * Pages of shared file mappings are left alone (their writes have to
+ * reach the shared frame), as are pages being filled or paged out.
+ * Frames already shared by fork or the page cache are not candidates;
+ * they are shared already.
+ *
+ * Pages are matched against two tables: merged frames ("stable", only
+ * ever mapped read-only so their contents cannot change), and pages
+ * seen earlier in the current pass ("unstable", reset at the end of
+ * every pass). A finished pass is only followed by another once more
+ * user pages have been allocated.
+ *
+ * Functions:
+ *     ksm_scan       - scan up to KSM_SCANBUDGET pages. Called from
+ *                      vm_idle with interrupts off. Returns nonzero if
+ *                      there was anything to scan.
+ *     ksm_forget     - PADDR is being freed or made writable again;
+ *                      stop offering it as a merge target.
+ *     ksm_printstats - print scan and merge counts.
+ */
+
+//Pages hashed per call from the idle loop (each is a 4K hash, maybe a compare)
+#define KSM_SCANBUDGET 4
+
+int  ksm_scan(void);
+void ksm_forget(paddr_t paddr);
+void ksm_printstats(void);
+
+extern int ksm_enabled;
+extern unsigned long ksm_pages_scanned;
+extern unsigned long ksm_pages_merged;
+extern unsigned long ksm_pages_unmerged;
+
+#endif /* _KSM_H_ */
@@ -91,6 +91,25 @@ void *kmalloc(size_t sz);
 void kfree(void *ptr);
 void kheap_printstats(void);
 
+/*
+ * Object caches, for kernel objects of one size that come and go all
+ * the time. kcache_create makes a cache of SIZE-byte objects (NULL if
+ * out of memory); CTOR, if not NULL, is run on each object once, when
+ * the cache first gets memory for it. kcache_alloc returns an object
+ * in its constructed state (or NULL), and kcache_free takes it back -
+ * leave it constructed, because that is how the next caller gets it.
+ * kcache_shrink gives the cache's unused memory back and returns the
+ * number of pages freed; kcache_reap does that for every cache.
+ * Objects from a cache must not be passed to kfree.
+ */
+struct kcache;
+struct kcache *kcache_create(const char *name, size_t size,
+			     void (*ctor)(void *obj));
+void *kcache_alloc(struct kcache *kc);
+void kcache_free(struct kcache *kc, void *ptr);
+int kcache_shrink(struct kcache *kc);
+int kcache_reap(void);
+
 /*
  * C string functions. 
  *
@@ -20,6 +20,13 @@ typedef struct trapframe Trapframe;
 typedef struct trapframe* trapframeptr;
 typedef struct addrspace* addrspaceptr;
 
+struct timespec;
+
+//Child trapframes handed from sys_fork to md_forkentry (made by oursyscall_bootstrap at boot)
+extern struct kcache* trapframe_cache;
+
+void oursyscall_bootstrap(void);
+
 int sys_fork(trapframeptr, int*);
 int sys_execv(const char*, char**, int*);
 int sys_getpid(void);
@@ -29,5 +36,10 @@ int sys_write(void*, size_t);
 int sys_read(void*, size_t);
 int sys__time(time_t*, unsigned long*, int*);
 int sys_sbrk(intptr_t, int*);
+int sys_mmap(const char*, size_t, int, int, userptr_t, int*);
+int sys_munmap(vaddr_t, size_t);
+int sys_madvise(vaddr_t, size_t, int);
+int sys_nanosleep(const struct timespec*, struct timespec*);
+int sys_getvmstats(int, struct vmstats*);
 
 #endif //OURSYSCALL_H
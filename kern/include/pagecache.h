@@ -0,0 +1,39 @@
+#ifndef _PAGECACHE_H_
+#define _PAGECACHE_H_
+
+#include <vm.h>
+
+/*
+ * Cache of executable file pages, shared by every address space that
+ * maps them.
+ *
+ * Pages are keyed by vnode and file offset. The cache holds its own
+ * reference on each frame (coremap state) and on each vnode, so a page
+ * stays cached after the last process using it exits and the next exec
+ * of the same program finds it without any disk I/O. Address spaces map
+ * cached pages read-only with PTE_COW, so a stray write gets a private
+ * copy instead of changing the shared page.
+ *
+ * Functions:
+ *     pagecache_lookup     - find the frame caching (V, OFFSET). Returns
+ *                            it with a reference added for the caller,
+ *                            or 0 if it is not cached.
+ *     pagecache_insert     - cache PADDR as (V, OFFSET). The caller keeps
+ *                            its own reference. Returns an error code.
+ *     pagecache_shrink     - free cached pages nobody maps any more.
+ *                            Returns how many were freed.
+ *     pagecache_forget     - drop (V, OFFSET) from the cache after the
+ *                            file was written there. Processes already
+ *                            mapping the old page keep it.
+ *     pagecache_printstats - print hit/miss counts and cache size.
+ */
+
+struct vnode;
+
+paddr_t pagecache_lookup(struct vnode* v, off_t offset);
+int     pagecache_insert(struct vnode* v, off_t offset, paddr_t paddr);
+int     pagecache_shrink(void);
+void    pagecache_forget(struct vnode* v, off_t offset);
+void    pagecache_printstats(void);
+
+#endif /* _PAGECACHE_H_ */
@@ -0,0 +1,71 @@
+#ifndef _PAGETABLE_H_
+#define _PAGETABLE_H_
+
+#include <vm.h>
+#include <machine/tlb.h>
+
+/*
+ * Two-level (radix) page table, one per address space.
+ *
+ * The top 10 bits of a user address pick a slot in the directory and
+ * the next 10 bits pick an entry in a page-sized second-level table.
+ * Second-level tables are only allocated once something is mapped in
+ * their 4MB range, so a sparse address space (text at the bottom,
+ * stack at the top) costs a couple of pages.
+ *
+ * Entries are kept in the same layout as TLBLO (physical page number
+ * plus the VALID/DIRTY bits) so a hit can be loaded into the TLB
+ * without translation. An entry of 0 means nothing is mapped; an entry
+ * without TLBLO_VALID may still record a paged-out page (see swap.h).
+ *
+ * Functions:
+ *     pt_create  - allocate an empty page table. Returns NULL if out
+ *                  of memory.
+ *     pt_lookup  - return a pointer to the entry for VADDR, or NULL
+ *                  if its second-level table was never allocated.
+ *     pt_insert  - set the entry for VADDR, allocating the second-level
+ *                  table if needed. Whatever was there is overwritten,
+ *                  so a fault that may have slept must check it first.
+ *                  Returns an error code.
+ *     pt_remove  - clear the entry for VADDR and hand back what was there.
+ *     pt_destroy - free the tables. Does not touch the mapped frames;
+ *                  the caller must release those first.
+ */
+
+#define PT_DIRSHIFT    22
+#define PT_ENTRYSHIFT  12
+#define PT_ENTRYMASK   0x3ff
+
+//Only kuseg is mapped through the page table (2GB -> 512 directory slots)
+#define PT_NUMDIRS     (USERTOP >> PT_DIRSHIFT)
+#define PT_NUMENTRIES  (PAGE_SIZE / sizeof(PageTableEntry))
+
+#define PT_DIRINDEX(vaddr)   ((vaddr) >> PT_DIRSHIFT)
+#define PT_ENTRYINDEX(vaddr) (((vaddr) >> PT_ENTRYSHIFT) & PT_ENTRYMASK)
+
+//Size of the range covered by one second-level table
+#define PT_TABLESPAN   (1 << PT_DIRSHIFT)
+
+//Entry helpers (TLBLO layout)
+#define PTE_PADDR(pte)   ((pte) & PAGE_FRAME)
+#define PTE_PRESENT(pte) (((pte) & TLBLO_VALID) != 0)
+
+//The low 8 bits of TLBLO are unused by the hardware, so software flags live there
+#define PTE_TLBBITS      0xffffff00
+#define PTE_COW          0x00000001  /* write access dropped to share the frame after fork */
+#define PTE_MERGED       0x00000004  /* frame shared by the samepage merger (see ksm.h) */
+#define PTE_UNREF        0x00000008  /* clock hand cleared the referenced bit: refill through vm_fault */
+
+typedef u_int32_t PageTableEntry;
+
+typedef struct pageTable {
+	PageTableEntry* tables[PT_NUMDIRS];
+} PageTable;
+
+PageTable*      pt_create(void);
+PageTableEntry* pt_lookup(PageTable* pt, vaddr_t vaddr);
+int             pt_insert(PageTable* pt, vaddr_t vaddr, PageTableEntry entry);
+PageTableEntry  pt_remove(PageTable* pt, vaddr_t vaddr);
+void            pt_destroy(PageTable* pt);
+
+#endif /* _PAGETABLE_H_ */
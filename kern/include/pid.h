@@ -0,0 +1,53 @@
+#ifndef _PID_H_
+#define _PID_H_
+
+#include <thread.h>
+
+/*
+ * Process IDs and the process table.
+ *
+ * Every thread gets a PID from thread_create. The table is an array of
+ * Process entries indexed by PID; free entries are on a FIFO free list,
+ * so allocation is constant time and a freed PID goes to the back of
+ * the line instead of being handed out again right away. When the list
+ * runs dry the table doubles, up to PID_MAX entries.
+ *
+ * A process's parent is whoever created it. While the parent is alive,
+ * an exiting child's entry stays (a zombie) holding the exit code until
+ * the parent collects it with waitpid, which frees the PID; so the PID
+ * cannot be handed to someone else while the parent may still wait for
+ * it. Children whose parent already exited are freed as soon as they
+ * exit, and a parent that exits frees its zombie children and orphans
+ * the rest. Kernel threads (the menu, tests) mostly never wait, so when
+ * one forks, its zombie children nobody is waiting for are freed first.
+ *
+ * Functions:
+ *     pid_bootstrap   - create the table. Called by thread_bootstrap.
+ *     pid_alloc       - give thread T a PID (in T->pid), a child of the
+ *                       current thread. Returns an error code.
+ *     pid_setexitcode - record the code PID exits with (sys__exit).
+ *     pid_exit        - PID is exiting.
+ *     pid_release     - undo pid_alloc for a thread that never ran.
+ *     pid_wait        - wait for child PID of the current thread to
+ *                       exit, put its exit code in STATUS and free the
+ *                       PID. Returns an error code.
+ *     pid_printstats  - print table size and how many PIDs are in use.
+ */
+
+//Largest the table grows (so largest PID + 1)
+#define PID_MAX 32768
+
+//States of a process table entry (Process.pidUsed)
+#define PROC_FREE    0   /* PID unused */
+#define PROC_ZOMBIE  1   /* exited, waiting for waitpid */
+#define PROC_RUNNING 2
+
+void pid_bootstrap(void);
+int  pid_alloc(struct thread* t);
+void pid_setexitcode(pid_t pid, int exitcode);
+void pid_exit(pid_t pid);
+void pid_release(pid_t pid);
+int  pid_wait(pid_t pid, int* status);
+void pid_printstats(void);
+
+#endif /* _PID_H_ */
@@ -16,12 +16,24 @@
  *     scheduler_shutdown -  clean up scheduler data
  *     scheduler_preallocate - ensure space for at least NUMTHREADS threads.
  *                           Returns an error code.
+ *
+ *     scheduler_tick   - charge a clock tick to the current thread. Returns
+ *                        nonzero if it should yield. Called by hardclock.
+ *     scheduler_wakeup - note that thread T slept and is being woken up.
+ *                        Call before make_runnable.
+ *
+ *     sched_quantum    - clock ticks in a time slice. May be changed at
+ *                        any time.
  */
 
 struct thread;
 
 struct thread *scheduler(void);
 int make_runnable(struct thread *t);
+int scheduler_tick(void);
+void scheduler_wakeup(struct thread *t);
+
+extern int sched_quantum;
 
 void print_run_queue(void);
 
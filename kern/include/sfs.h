@@ -35,6 +35,11 @@ struct sfs_fs {
  */
 int sfs_mount(const char *device);
 
+/*
+ * Call once during system startup, before anything is mounted.
+ */
+void sfs_bootstrap(void);
+
 
 /*
  * Internal functions
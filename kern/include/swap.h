@@ -0,0 +1,68 @@
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+#include <vm.h>
+#include <pagetable.h>
+
+/*
+ * Demand paging to the swap disk.
+ *
+ * The second disk (lhd1raw:) is split into page-sized slots tracked by
+ * a bitmap. When memory runs low a resident user page is written to a
+ * free slot and its page table entry is changed to remember the slot;
+ * touching it again faults and reads it back in.
+ *
+ * Only pages mapped by a single page table are candidates (pages that
+ * fork is sharing copy-on-write are left alone until all but one of
+ * their mappings are gone). By default the victim
+ * is picked with the clock (second-chance) algorithm, using the
+ * referenced bit vm_fault sets whenever it loads a page into the TLB.
+ * Configure with "options swapfifo" to evict in plain arrival order
+ * instead.
+ *
+ * Functions:
+ *     swap_bootstrap  - open the swap disk. If there is none, paging out
+ *                       is disabled and user memory is limited to RAM.
+ *     swap_enabled    - nonzero if pages can be paged out.
+ *     swap_track      - make a user page of AS at VADDR evictable.
+ *     swap_untrack    - stop considering a page for eviction.
+ *     swap_unshared   - a shared page is down to one mapping again. The
+ *                       pager does not know whose, so it is flagged and
+ *                       the next swap_evict finds its mapper (as_retrack)
+ *                       and makes it evictable again.
+ *     swap_evict      - page one resident page out and free its frame.
+ *     swap_in         - read a swapped-out page back in and remap it.
+ *     swap_free       - drop the slot held by a swapped-out entry.
+ *     swap_lock       - wait for a page-out in progress to finish and
+ *                       keep new ones from starting. Held while tearing
+ *                       down mappings, so a slot is never freed while
+ *                       its page is still being written to it.
+ *     swap_unlock     - let page-outs go again.
+ *     swap_printstats - print page-in/page-out counts and slot usage.
+ */
+
+//Start paging out when fewer than this many pages are free, so the
+//kernel (which never pages out) still has memory to work with
+#define SWAP_LOWWATER 16
+
+//A paged-out entry has VALID clear, PTE_SWAPPED set and the slot number where the frame number goes
+#define PTE_SWAPPED       0x00000002
+#define PTE_ISSWAPPED(pte) (((pte) & PTE_SWAPPED) != 0)
+#define PTE_SLOT(pte)      ((pte) >> PT_ENTRYSHIFT)
+
+void swap_bootstrap(void);
+int  swap_enabled(void);
+void swap_track(paddr_t paddr, struct addrspace* as, vaddr_t vaddr);
+void swap_untrack(paddr_t paddr);
+void swap_unshared(paddr_t paddr);
+int  swap_evict(void);
+int  swap_in(struct addrspace* as, vaddr_t vaddr, PageTableEntry* entry);
+void swap_free(PageTableEntry entry);
+void swap_lock(void);
+void swap_unlock(void);
+void swap_printstats(void);
+
+extern unsigned long swap_pageins;
+extern unsigned long swap_pageouts;
+
+#endif /* _SWAP_H_ */
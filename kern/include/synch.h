@@ -13,6 +13,8 @@
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *     P_timeout:    P, but give up after MSECS milliseconds. Returns 0,
+ *                   or ETIMEDOUT without decrementing.
  * 
  * Both operations are atomic.
  *
@@ -28,6 +30,7 @@ struct semaphore {
 struct semaphore *sem_create(const char *name, int initial_count);
 void              P(struct semaphore *);
 void              V(struct semaphore *);
+int               P_timeout(struct semaphore *, u_int32_t msecs);
 void              sem_destroy(struct semaphore *);
 
 
@@ -40,6 +43,9 @@ void              sem_destroy(struct semaphore *);
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock; 
  *                   false otherwise.
+ *    lock_acquire_timeout - lock_acquire, but give up after MSECS
+ *                   milliseconds. Returns 0, or ETIMEDOUT without the
+ *                   lock.
  *
  * These operations must be atomic. You get to write them.
  *
@@ -59,6 +65,7 @@ struct lock {
 
 struct lock *lock_create(const char *name);
 void         lock_acquire(struct lock *);
+int          lock_acquire_timeout(struct lock *, u_int32_t msecs);
 void         lock_release(struct lock *);
 int          lock_do_i_hold(struct lock *);
 void         lock_destroy(struct lock *);
@@ -76,6 +83,9 @@ void         lock_destroy(struct lock *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_wait_timeout - cv_wait, but stop waiting after MSECS
+ *                   milliseconds. The lock is re-acquired either way;
+ *                   returns ETIMEDOUT if the time ran out, else 0.
  *
  * For all three operations, the current thread must hold the lock passed 
  * in. Note that under normal circumstances the same lock should be used
@@ -98,8 +108,15 @@ struct cv {
 
 struct cv *cv_create(const char *name);
 void       cv_wait(struct cv *cv, struct lock *lock);
+int        cv_wait_timeout(struct cv *cv, struct lock *lock, u_int32_t msecs);
 void       cv_signal(struct cv *cv, struct lock *lock);
 void       cv_broadcast(struct cv *cv, struct lock *lock);
 void       cv_destroy(struct cv *);
 
+/*
+ * Create the object caches semaphores and locks come from. Call once
+ * during startup, before anything creates one.
+ */
+void synch_bootstrap(void);
+
 #endif /* _SYNCH_H_ */
@@ -24,9 +24,14 @@ int queuetest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int latencybench(int, char **);
+int forkexitbench(int, char **);
+int failexectest(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int sleeptest(int, char **);
+int timedtest(int, char **);
 
 /* filesystem tests */
 int fstest(int, char **);
@@ -41,6 +46,13 @@ int malloctest(int, char **);
 int mallocstress(int, char **);
 int nettest(int, char **);
 
+/* vm benchmarks */
+int ptbench(int, char **);
+int forkbench(int, char **);
+int ctxbench(int, char **);
+int mmapbench(int, char **);
+int tlbbench(int, char **);
+
 /* Kernel menu system */
 void menu(char *argstr);
 
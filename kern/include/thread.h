@@ -20,8 +20,6 @@
 
 struct addrspace;
 
-extern int currentpidcount;
-
 struct thread {
 	/**********************************************************/
 	/* Private thread members - internal to the thread system */
@@ -30,7 +28,11 @@ struct thread {
 	struct pcb t_pcb;
 	char *t_name;
 	const void *t_sleepaddr;
+	struct thread *t_sleepnext;	/* next in the same sleep bucket */
+	int t_timedout;			/* woken by thread_sleep_until's timer */
 	char *t_stack;
+	int t_priority;		/* MLFQ level, 0 is highest */
+	int t_ticks;		/* ticks used of the current quantum */
 	
 	/**********************************************************/
 	/* Public thread members - can be used by other code      */
@@ -64,27 +66,33 @@ struct thread {
 typedef struct thread Thread;
 typedef struct thread* threadptr;
 
-//Process struct
+//Process struct (an entry in the process table, see pid.h)
 struct process {
-	//This is the pid of the parent
-	//int parentpid;
 	//This is my PID
 	int pid;
 	//This is to determine whether or not the PID is used
-	//0 means the PID is unused
-	//1 means the process has exited but things are waiting on it
-	//2 means the process is running
+	//PROC_FREE (0) means the PID is unused
+	//PROC_ZOMBIE (1) means the process has exited but things are waiting on it
+	//PROC_RUNNING (2) means the process is running
 	int pidUsed;
 	//This is the exitcode
 	int exit_code;
-	//This is the semaphore to see if I can exit or not
-	struct lock* exitlock;
-	//children
-	//struct array* children;
+	//V'd when the process exits; made once per table entry and reused
+	struct semaphore* exitsem;
 	//the thread itself
 	struct thread* thread;
 	//if i have been waited on
 	int waited;
+	//This is the pid of the parent (-1 if nobody will wait for us)
+	int ppid;
+	//children, as a list through the process table (-1 terminated)
+	int firstchild;
+	//how many of them are zombies
+	int nzombies;
+	int nextsibling;
+	int prevsibling;
+	//next on the free list
+	int nextfree;
 };
 
 typedef struct process Process;
@@ -135,6 +143,13 @@ void thread_yield(void);
  */
 void thread_sleep(const void *addr);
 
+/*
+ * Like thread_sleep, but wake up anyway at clock tick DEADLINE (see
+ * timer.h). Returns ETIMEDOUT if that is what happened, 0 if woken by
+ * thread_wakeup. Interrupts must be disabled.
+ */
+int thread_sleep_until(const void *addr, u_int32_t deadline);
+
 /*
  * Cause all threads sleeping on the specified address to wake up.
  * Interrupts must be disabled.
@@ -150,6 +165,16 @@ void thread_wakeone(const void *addr);
  */
 int thread_hassleepers(const void *addr);
 
+/*
+ * Exited threads are kept, stack and all, for thread_fork to reuse.
+ * thread_setshells sets how many (0 turns this off) and returns the
+ * old limit; thread_shrink frees them all and returns the number of
+ * stacks freed.
+ */
+int thread_setshells(int max);
+int thread_shrink(void);
+void thread_printstats(void);
+
 
 /*
  * Private thread functions.
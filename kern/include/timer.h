@@ -0,0 +1,66 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*
+ * Kernel timers.
+ *
+ * Time is counted in clock ticks (HZ a second, see clock.h) since boot.
+ * Pending timers live in a three-level timing wheel of 64 slots each:
+ * the first level holds timers due in the next 64 ticks, one tick per
+ * slot, and each level above covers 64 times as much time per slot.
+ * Timers move down a level as their time gets close, so adding,
+ * cancelling and expiring a timer are all constant time whatever the
+ * number pending. Timers are driven from hardclock, including the
+ * ticks skipped while the tick is stopped.
+ *
+ * A struct timer is owned by the caller (it can live on the stack) and
+ * needs no allocation. Timer functions are called from the timer
+ * interrupt and must not sleep.
+ *
+ * Functions (interrupts must be off for timer_set and timer_cancel):
+ *     timer_init        - set up T to call FUNC(DATA).
+ *     timer_set         - arm T to go off at tick EXPIRES (one already
+ *                         in the past goes off on the next tick). T
+ *                         must not be pending.
+ *     timer_cancel      - disarm T. Returns nonzero if it was pending.
+ *     timer_now         - the current tick.
+ *     timer_ms2ticks    - convert milliseconds to ticks, rounding up.
+ *     timer_deadline    - the first tick at least MSECS milliseconds
+ *                         from now (timer_now itself for 0). The
+ *                         current tick is partly over, so this is one
+ *                         more than the conversion.
+ *     timer_sleep       - put the current thread to sleep for at least
+ *                         TICKS whole ticks.
+ *     timer_printstats  - print how many timers are pending and have
+ *                         gone off.
+ *
+ * For the clock code:
+ *     timer_advance     - note that TICKS more ticks have gone by.
+ *     timer_run         - run the timers due by the ticks noted so
+ *                         far. Only called by hardclock.
+ *     timer_next        - ticks from now until the wheel next needs to
+ *                         run (at least 1), or 0 if nothing is pending.
+ */
+
+struct timer {
+	struct timer *tm_next;		/* in its wheel slot */
+	struct timer **tm_prevp;	/* what points to us; NULL if idle */
+	u_int32_t tm_expires;		/* tick to go off at */
+	void (*tm_func)(void *);
+	void *tm_data;
+};
+
+void      timer_init(struct timer *t, void (*func)(void *), void *data);
+void      timer_set(struct timer *t, u_int32_t expires);
+int       timer_cancel(struct timer *t);
+u_int32_t timer_now(void);
+u_int32_t timer_ms2ticks(u_int32_t msecs);
+u_int32_t timer_deadline(u_int32_t msecs);
+void      timer_sleep(u_int32_t ticks);
+void      timer_printstats(void);
+
+void      timer_advance(u_int32_t ticks);
+void      timer_run(void);
+u_int32_t timer_next(void);
+
+#endif /* _TIMER_H_ */
@@ -2,6 +2,7 @@
 #define _VM_H_
 
 #include <machine/vm.h>
+#include <kern/vmstats.h>
 
 
 /*
@@ -33,12 +34,116 @@ vaddr_t alloc_kpages(int npages);
 void free_kpages(vaddr_t addr);
 paddr_t getppages(unsigned long npages);
 
+struct addrspace;
+/*
+ * Allocate a frame for a user page, paging something out if memory is
+ * short. The frame comes back busy; once it is filled and mapped at VADDR
+ * in AS, userPageReady clears that and lets the pager consider it.
+ */
+paddr_t getUserPage(void);
+void userPageReady(paddr_t paddr, struct addrspace* as, vaddr_t vaddr);
+
+/*
+ * Pre-zeroed frames. The scheduler's idle loop calls vm_idle (interrupts
+ * off) to zero one free frame into a pool of up to ZEROPOOL_HIGH, or
+ * once the pool is full to do a slice of samepage merging (ksm.h); it
+ * returns 0 once there is nothing to do. getZeroedPage is getUserPage
+ * for anonymous memory: it takes a pool frame if there is one and
+ * zeroes a fresh frame otherwise.
+ */
+#define ZEROPOOL_HIGH 32
+int vm_idle(void);
+paddr_t getZeroedPage(void);
+extern unsigned long zeropool_hits;
+extern unsigned long zeropool_misses;
+
+/* Drop a reference to a user page allocated with getppages(1) */
+void releasePage(paddr_t paddr);
+
+/* Add a reference to a user page that another page table now maps too */
+void sharePage(paddr_t paddr);
+
+/*
+ * VM counters (see kern/vmstats.h), kept for the whole system and for
+ * each address space. VMSTAT_INC bumps both; AS may be NULL.
+ */
+extern struct vmstats vm_globalstats;
+#define VMSTAT_INC(as, field) do { \
+		vm_globalstats.field++; \
+		if ((as) != NULL) (as)->stats.field++; \
+	} while (0)
+void vm_printstats(const struct vmstats* stats);
+
+/* Copy-on-write counters (pages shared by fork, pages copied on first write) */
+extern unsigned long cow_pages_shared;
+extern unsigned long cow_pages_copied;
+
+/*
+ * TLB management. Entries are tagged with the address space's ASID.
+ *     tlb_load      - refill one entry of the current address space
+ *                     (round-robin replacement once the TLB is full).
+ *     tlb_shootdown - invalidate one page of an address space (AS NULL:
+ *                     a global kseg2 page).
+ *     tlb_flush     - invalidate everything.
+ *     tlb_flush_as  - invalidate every entry of one address space.
+ *     tlb_activate  - switch to an address space, assigning it an ASID.
+ *     tlb_release   - flush an address space and free its ASID.
+ *
+ * Most misses never get here: the UTLB vector (exception.S) walks
+ * curpagetable itself and only falls back to vm_fault when the entry is
+ * missing, invalid or marked PTE_UNREF. tlb_activate points curpagetable
+ * at the new address space's table, or at NULL when utlb_fastpath is
+ * off. tlb_misses counts the vm_fault refills, tlb_fastrefills the rest.
+ */
+void tlb_load(vaddr_t vaddr, u_int32_t elo);
+void tlb_shootdown(struct addrspace* as, vaddr_t vaddr);
+void tlb_flush(void);
+void tlb_flush_as(struct addrspace* as);
+void tlb_activate(struct addrspace* as);
+void tlb_release(struct addrspace* as);
+void tlb_printstats(void);
+
+extern struct pageTable* curpagetable;
+extern int utlb_fastpath;
+extern unsigned long tlb_misses;
+extern unsigned long tlb_fastrefills;
+extern unsigned long tlb_evictions;
+extern unsigned long tlb_shootdowns;
+extern unsigned long tlb_rollovers;
+
+/* Zero page counters (reads served by the shared zero page, zero pages later written) and memory report */
+extern paddr_t zeroPage;
+extern unsigned long zero_pages_mapped;
+extern unsigned long zero_pages_filled;
+void vm_printmemstats(void);
+
+/* Fault-around counters (file reads done by vm_fault, pages they brought in) */
+extern unsigned long cluster_faults;
+extern unsigned long cluster_pages;
+void cluster_printstats(void);
+
+/* Translate a user address through a page table (0 if nothing is mapped) */
+struct pageTable;
+paddr_t findAddress(struct pageTable* searchTable, vaddr_t searchKey);
+
+//Largest block the buddy allocator hands out (2^CM_MAXORDER pages)
+#define CM_MAXORDER 16
+
 //Coremap element structure
+//The coremap covers all of physical memory after the kernel and is itself allocated at bootstrap.
+//Pages are handed out in power-of-two blocks; the first page of a block records its order.
+//User pages that only one page table maps can be paged out; swap.c keeps those on a list
+//through the same links the free lists use (a page is never on both).
 typedef struct coremap_entry {
-    //vaddr_t virtualaddr;
-    //int timesReferenced;
-    int state;
-    int pagesRemaining;
+    int state;     //reference count, CM_FREE when the page is not in use
+    int order;     //buddy order if this page heads a block, -1 otherwise
+    int next;      //free list or resident list links (coremap indexes, -1 terminated)
+    int prev;
+    struct addrspace* owner;  //address space mapping this page if it can be evicted, NULL otherwise
+    vaddr_t vaddr;            //where owner maps it
+    int referenced;           //set when the page is loaded into the TLB, cleared by the clock hand
+    int busy;                 //being filled or written out; nobody else may touch it until this clears
+    int unshared;             //back to one reference, but nobody knows whose; see swap_unshared
  } Coremap_entry;
 
 //Comparison helper func
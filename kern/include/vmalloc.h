@@ -0,0 +1,45 @@
+#ifndef _VMALLOC_H_
+#define _VMALLOC_H_
+
+#include <vm.h>
+
+/*
+ * Virtually contiguous kernel memory in kseg2.
+ *
+ * alloc_kpages needs physically contiguous frames, which stop being
+ * available once memory is fragmented even if plenty of it is free.
+ * vmalloc takes any free frames one at a time and maps them at
+ * consecutive addresses in kseg2 through a kernel page table. The TLB
+ * entries are global, so they match whatever address space is current,
+ * and a miss goes through vm_fault to vmalloc_fault. Every page is
+ * mapped when it is allocated, so touching vmalloc memory never has
+ * to allocate anything. Each area is followed by an unmapped guard
+ * page, so running off the end faults instead of corrupting a
+ * neighbour.
+ *
+ * kmalloc falls back to vmalloc for multi-page requests alloc_kpages
+ * cannot satisfy, and kfree hands kseg2 addresses to vfree. Memory
+ * from vmalloc has no kseg0 alias (KVADDR_TO_PADDR does not work on
+ * it) and must not be touched where a TLB miss is not allowed - in
+ * the UTLB handler or as a kernel stack. Page tables and stacks are
+ * single pages, which never come from here.
+ *
+ * Functions:
+ *     vmalloc           - allocate SIZE bytes (rounded up to pages).
+ *                         Returns NULL if out of frames or kseg2 space.
+ *     vfree             - free memory from vmalloc.
+ *     vmalloc_fault     - load the TLB entry for kseg2 address VADDR.
+ *                         Returns EFAULT if nothing is mapped there.
+ *     vmalloc_printstats - print areas and pages in use.
+ */
+
+//Part of kseg2 handed out (64MB, so at most 16 second-level tables)
+#define VMALLOC_BASE  MIPS_KSEG2
+#define VMALLOC_PAGES 16384
+
+void *vmalloc(size_t size);
+void  vfree(void *ptr);
+int   vmalloc_fault(vaddr_t vaddr);
+void  vmalloc_printstats(void);
+
+#endif /* _VMALLOC_H_ */
@@ -1,6 +1,7 @@
 #include <types.h>
 #include <lib.h>
 #include <vm.h>
+#include <vmalloc.h>
 #include <machine/spl.h>
 
 static
@@ -285,6 +286,8 @@ dumpsubpage(struct pageref *pr)
 	kprintf("\n");
 }
 
+static void kcache_printstats(void);
+
 void
 kheap_printstats(void)
 {
@@ -299,6 +302,9 @@ kheap_printstats(void)
 		dumpsubpage(pr);
 	}
 
+	kcache_printstats();
+	vmalloc_printstats();
+
 	splx(spl);
 }
 
@@ -539,6 +545,275 @@ subpage_kfree(void *ptr)
 	return 0;
 }
 
+//
+////////////////////////////////////////////////////////////
+//
+// Object caches.
+//
+// Each cache carves whole pages ("slabs") into slots for objects of
+// one size. A slab starts with a struct kslab and keeps its free slots
+// on its own freelist. The freelist link goes in a word after each
+// object instead of in the object, so a freed object keeps its state:
+// objects are constructed once, when their slab is made, and come back
+// from kcache_alloc the way the last user left them.
+//
+// Slabs with free slots are on the cache's partial list and full ones
+// on its full list, so allocating never searches. The slab an object
+// belongs to is found from its page address. Empty slabs are kept for
+// reuse until kcache_shrink returns them to the page allocator.
+//
+
+struct kslab {
+	struct kslab *ks_next;		/* on kc_partial or kc_full */
+	struct kslab *ks_prev;
+	struct kcache *ks_cache;
+	vaddr_t ks_free;		/* first free slot, 0 if none */
+	unsigned ks_nfree;
+};
+
+struct kcache {
+	const char *kc_name;
+	size_t kc_objsize;		/* size asked for */
+	size_t kc_slotsize;		/* object + freelist link, aligned */
+	unsigned kc_perslab;
+	void (*kc_ctor)(void *obj);
+	struct kslab *kc_partial;	/* slabs with free slots */
+	struct kslab *kc_full;		/* slabs without */
+	unsigned kc_nslabs;
+	unsigned kc_inuse;
+	unsigned long kc_allocs;
+	unsigned long kc_frees;
+	struct kcache *kc_next;		/* list of all caches */
+};
+
+#define KSLAB_HEADER  ((sizeof(struct kslab) + 7) & ~(size_t)7)
+#define KSLAB_LINK(kc, slot) \
+	(*(vaddr_t *)((slot) + (kc)->kc_slotsize - sizeof(vaddr_t)))
+#define KSLAB_OF(ptr) ((struct kslab *)((vaddr_t)(ptr) & PAGE_FRAME))
+
+static struct kcache *allcaches;
+
+struct kcache *
+kcache_create(const char *name, size_t size, void (*ctor)(void *obj))
+{
+	struct kcache *kc;
+	int spl;
+
+	kc = kmalloc(sizeof(struct kcache));
+	if (kc == NULL) {
+		return NULL;
+	}
+
+	kc->kc_name = name;
+	kc->kc_objsize = size;
+	kc->kc_slotsize = (size + sizeof(vaddr_t) + 7) & ~(size_t)7;
+	kc->kc_perslab = (PAGE_SIZE - KSLAB_HEADER) / kc->kc_slotsize;
+	if (kc->kc_perslab == 0) {
+		panic("kcache_create: %s: objects of size %lu do not fit "
+		      "in a page\n", name, (unsigned long) size);
+	}
+	kc->kc_ctor = ctor;
+	kc->kc_partial = kc->kc_full = NULL;
+	kc->kc_nslabs = 0;
+	kc->kc_inuse = 0;
+	kc->kc_allocs = kc->kc_frees = 0;
+
+	spl = splhigh();
+	kc->kc_next = allcaches;
+	allcaches = kc;
+	splx(spl);
+
+	return kc;
+}
+
+static
+void
+kslab_unlink(struct kslab **list, struct kslab *ks)
+{
+	if (ks->ks_prev != NULL) {
+		ks->ks_prev->ks_next = ks->ks_next;
+	}
+	else {
+		*list = ks->ks_next;
+	}
+	if (ks->ks_next != NULL) {
+		ks->ks_next->ks_prev = ks->ks_prev;
+	}
+}
+
+static
+void
+kslab_push(struct kslab **list, struct kslab *ks)
+{
+	ks->ks_prev = NULL;
+	ks->ks_next = *list;
+	if (*list != NULL) {
+		(*list)->ks_prev = ks;
+	}
+	*list = ks;
+}
+
+/*
+ * Get a new slab for KC, with every object constructed, and put it
+ * on the partial list.
+ */
+static
+struct kslab *
+kslab_create(struct kcache *kc)
+{
+	struct kslab *ks;
+	vaddr_t page, slot;
+	unsigned i;
+
+	page = alloc_kpages(1);
+	if (page == 0) {
+		return NULL;
+	}
+
+	ks = (struct kslab *)page;
+	ks->ks_cache = kc;
+	ks->ks_free = 0;
+	ks->ks_nfree = kc->kc_perslab;
+
+	/* Chain the slots so the first one is handed out first. */
+	for (i = kc->kc_perslab; i > 0; i--) {
+		slot = page + KSLAB_HEADER + (i-1) * kc->kc_slotsize;
+		if (kc->kc_ctor != NULL) {
+			kc->kc_ctor((void *)slot);
+		}
+		KSLAB_LINK(kc, slot) = ks->ks_free;
+		ks->ks_free = slot;
+	}
+
+	kslab_push(&kc->kc_partial, ks);
+	kc->kc_nslabs++;
+	return ks;
+}
+
+void *
+kcache_alloc(struct kcache *kc)
+{
+	struct kslab *ks;
+	vaddr_t slot;
+	int spl;
+
+	spl = splhigh();
+
+	ks = kc->kc_partial;
+	if (ks == NULL) {
+		ks = kslab_create(kc);
+		if (ks == NULL) {
+			splx(spl);
+			return NULL;
+		}
+	}
+
+	slot = ks->ks_free;
+	assert(slot != 0 && ks->ks_nfree > 0);
+	ks->ks_free = KSLAB_LINK(kc, slot);
+	ks->ks_nfree--;
+	if (ks->ks_nfree == 0) {
+		kslab_unlink(&kc->kc_partial, ks);
+		kslab_push(&kc->kc_full, ks);
+	}
+
+	kc->kc_inuse++;
+	kc->kc_allocs++;
+
+	splx(spl);
+	return (void *)slot;
+}
+
+void
+kcache_free(struct kcache *kc, void *ptr)
+{
+	struct kslab *ks;
+	vaddr_t slot = (vaddr_t)ptr;
+	int spl;
+
+	if (ptr == NULL) {
+		return;
+	}
+
+	ks = KSLAB_OF(ptr);
+	if (ks->ks_cache != kc ||
+	    (slot - (vaddr_t)ks - KSLAB_HEADER) % kc->kc_slotsize != 0) {
+		panic("kcache_free: %p is not an object of cache %s\n",
+		      ptr, kc->kc_name);
+	}
+
+	spl = splhigh();
+
+	if (ks->ks_nfree == 0) {
+		kslab_unlink(&kc->kc_full, ks);
+		kslab_push(&kc->kc_partial, ks);
+	}
+	KSLAB_LINK(kc, slot) = ks->ks_free;
+	ks->ks_free = slot;
+	ks->ks_nfree++;
+	assert(ks->ks_nfree <= kc->kc_perslab);
+
+	kc->kc_inuse--;
+	kc->kc_frees++;
+
+	splx(spl);
+}
+
+int
+kcache_shrink(struct kcache *kc)
+{
+	struct kslab *ks, *next;
+	int freed = 0;
+	int spl;
+
+	spl = splhigh();
+	for (ks = kc->kc_partial; ks != NULL; ks = next) {
+		next = ks->ks_next;
+		if (ks->ks_nfree == kc->kc_perslab) {
+			kslab_unlink(&kc->kc_partial, ks);
+			kc->kc_nslabs--;
+			free_kpages((vaddr_t)ks);
+			freed++;
+		}
+	}
+	splx(spl);
+
+	return freed;
+}
+
+int
+kcache_reap(void)
+{
+	struct kcache *kc;
+	int freed = 0;
+
+	for (kc = allcaches; kc != NULL; kc = kc->kc_next) {
+		freed += kcache_shrink(kc);
+	}
+	return freed;
+}
+
+static
+void
+kcache_printstats(void)
+{
+	struct kcache *kc;
+	unsigned slots;
+
+	assert(curspl>0);
+
+	kprintf("Object caches:\n");
+	for (kc = allcaches; kc != NULL; kc = kc->kc_next) {
+		slots = kc->kc_nslabs * kc->kc_perslab;
+		kprintf("  %-12s %4lu bytes  %4u/%-4u in use (%3u%%), "
+			"%u pages, %lu allocs, %lu frees\n",
+			kc->kc_name, (unsigned long) kc->kc_objsize,
+			kc->kc_inuse, slots,
+			slots ? (kc->kc_inuse * 100) / slots : 0,
+			kc->kc_nslabs, kc->kc_allocs, kc->kc_frees);
+	}
+}
+
 //
 ////////////////////////////////////////////////////////////
 
@@ -552,6 +827,13 @@ kmalloc(size_t sz)
 		/* Round up to a whole number of pages. */
 		npages = (sz + PAGE_SIZE - 1)/PAGE_SIZE;
 		address = alloc_kpages(npages);
+		if (address==0 && npages > 1) {
+			/*
+			 * No run of free frames that long; map scattered
+			 * ones in kseg2 instead.
+			 */
+			return vmalloc(sz);
+		}
 		if (address==0) {
 			return NULL;
 		}
@@ -570,6 +852,8 @@ kfree(void *ptr)
 	 */
 	if (ptr == NULL) {
 		return;
+	} else if ((vaddr_t)ptr >= VMALLOC_BASE) {
+		vfree(ptr);
 	} else if (subpage_kfree(ptr)) {
 		assert((vaddr_t)ptr%PAGE_SIZE==0);
 		free_kpages((vaddr_t)ptr);
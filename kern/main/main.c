@@ -16,18 +16,19 @@
 #include <dev.h>
 #include <vfs.h>
 #include <vm.h>
+#include <swap.h>
 #include <syscall.h>
 #include <version.h>
 #include <ourfunctions.h>
 #include <ourextern.h>
 #include <array.h>
+#include <oursyscall.h>
+#include <sfs.h>
+#include "opt-sfs.h"
 
-//Set our global variable for PIDs here
-int currentpidcount = 0;
 u_int32_t firstpaddr = 0;
 int totalpages = 0;
-Process processtable[PROCESSTABLE_SIZE];
-Coremap_entry ourcoremap[COREMAP_SIZE];
+Coremap_entry* ourcoremap = NULL;
 
 
 
@@ -75,14 +76,6 @@ boot(void)
 	 * dev/generic/console.c).
 	 */
 
-
-	 //Here, I will fill the pidtable with 0s 
-	int pidtableindex;
-	for(pidtableindex = 0; pidtableindex < 100; pidtableindex++) {
-		processtable[pidtableindex].pid = pidtableindex;
-		processtable[pidtableindex].pidUsed = 0;
-		processtable[pidtableindex].waited = 0;
-	};
 	kprintf("\n");
 	kprintf("OS/161 base system version %s\n", BASE_VERSION);
 	kprintf("%s", harvard_copyright);
@@ -97,10 +90,20 @@ boot(void)
 	//Bootstrap the vm after ram
 	vm_bootstrap();
 
+	//Object caches for things created from here on
+	synch_bootstrap();
+	oursyscall_bootstrap();
+#if OPT_SFS
+	sfs_bootstrap();
+#endif
+
 	scheduler_bootstrap();
 	thread_bootstrap();
 	vfs_bootstrap();
 	dev_bootstrap();
+
+	//The swap disk is a device, so it can only be opened once devices are attached
+	swap_bootstrap();
 	
 	kprintf_bootstrap();
 
@@ -8,12 +8,19 @@
 #include <kern/limits.h>
 #include <lib.h>
 #include <clock.h>
+#include <machine/spl.h>
 #include <thread.h>
+#include <scheduler.h>
 #include <syscall.h>
 #include <uio.h>
 #include <vfs.h>
 #include <sfs.h>
 #include <test.h>
+#include <vm.h>
+#include <swap.h>
+#include <pagecache.h>
+#include <ksm.h>
+#include <pid.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -35,6 +42,16 @@ getinterval(time_t s1, u_int32_t ns1, time_t s2, u_int32_t ns2,
 	*rs = s2 - s1;
 }
 
+u_int32_t
+getinterval_usecs(time_t s1, u_int32_t ns1, time_t s2, u_int32_t ns2)
+{
+	time_t secs;
+	u_int32_t nsecs;
+
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+	return secs*1000000 + nsecs/1000;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Command menu functions 
@@ -394,6 +411,228 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for printing swap statistics.
+ */
+static
+int
+cmd_swapstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	swap_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for printing page cache statistics.
+ */
+static
+int
+cmd_pagecachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	pagecache_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for samepage merging: "ksm on" and "ksm off" turn the idle
+ * scan on and off (pages already merged stay merged), and every form
+ * prints how many pages were scanned, merged and unmerged.
+ */
+static
+int
+cmd_ksmstats(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		ksm_enabled = 1;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		ksm_enabled = 0;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: ksm [on|off]\n");
+		return EINVAL;
+	}
+
+	ksm_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for printing fault-around statistics.
+ */
+static
+int
+cmd_clusterstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	cluster_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for printing the memory accounting report.
+ */
+static
+int
+cmd_memstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vm_printmemstats();
+
+	return 0;
+}
+
+/*
+ * Command for printing the VM counters for the whole system.
+ * "vs reset" zeroes them first, to measure one run of something.
+ */
+static
+int
+cmd_vmstats(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		bzero(&vm_globalstats, sizeof(vm_globalstats));
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: vs [reset]\n");
+		return EINVAL;
+	}
+
+	vm_printstats(&vm_globalstats);
+
+	return 0;
+}
+
+/*
+ * Command for measuring how long interrupts stay off.
+ * "spl on" starts (or restarts) measuring, "spl off" stops, and plain
+ * "spl" prints the longest stretch seen so far.
+ */
+static
+int
+cmd_splstats(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		spl_measure_start();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		spl_measure_stop();
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: spl [on|off]\n");
+		return EINVAL;
+	}
+
+	kprintf("Interrupts-off time: longest %lu us (%s)\n",
+		(unsigned long) spl_maxoff_usecs,
+		spl_measuring ? "measuring" : "not measuring");
+
+	return 0;
+}
+
+/*
+ * Command for the scheduling quantum. "quantum N" makes a time slice
+ * N clock ticks; plain "quantum" prints it.
+ */
+static
+int
+cmd_quantum(int nargs, char **args)
+{
+	int n;
+
+	if (nargs == 2) {
+		n = atoi(args[1]);
+		if (n <= 0) {
+			kprintf("quantum: must be at least one tick\n");
+			return EINVAL;
+		}
+		sched_quantum = n;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: quantum [ticks]\n");
+		return EINVAL;
+	}
+
+	kprintf("Quantum: %d ticks (%d ms)\n", sched_quantum,
+		sched_quantum * 1000 / HZ);
+
+	return 0;
+}
+
+/*
+ * Command for tickless idle. "tickless on|off" allows or forbids
+ * stopping the clock tick when nothing needs it; either way the
+ * clock statistics are printed.
+ */
+static
+int
+cmd_tickless(int nargs, char **args)
+{
+	int spl;
+
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		clock_tickless = 1;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		spl = splhigh();
+		clock_tickless = 0;
+		clock_starttick();
+		splx(spl);
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: tickless [on|off]\n");
+		return EINVAL;
+	}
+
+	clock_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for printing TLB statistics.
+ */
+static
+int
+cmd_tlbstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	tlb_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for printing process table statistics.
+ */
+static
+int
+cmd_pidstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	pid_printstats();
+
+	return 0;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -487,17 +726,27 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Wakeup latency bench          ",
+	"[tt5] Thread fork+exit bench        ",
+	"[tt6] Failed-program wait test      ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[sy4] Many-sleeper wakeup test      ",
+	"[sy5] Timed wait test               ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress        (4)     ",
 	"[fs3] FS write stress       (4)     ",
 	"[fs4] FS write stress 2     (4)     ",
 	"[fs5] FS create stress      (4)     ",
+	"[vm1] Page table lookup bench       ",
+	"[vm2] Fork (as_copy) bench          ",
+	"[vm3] Context-switch TLB bench      ",
+	"[vm4] mmap vs read scan bench       ",
+	"[vm5] TLB refill bench              ",
 	NULL
 };
 
@@ -527,6 +776,17 @@ static const char *mainmenu[] = {
 	"[1c] Stoplight                      ",
 #endif
 	"[kh] Kernel heap stats              ",
+	"[sw] Swap stats                     ",
+	"[tlb] TLB stats                     ",
+	"[pc] Page cache stats               ",
+	"[ksm] Samepage merging [on|off]     ",
+	"[fa] Fault-around stats             ",
+	"[mem] Memory accounting             ",
+	"[vs] VM statistics [reset]          ",
+	"[spl] Interrupts-off time [on|off]  ",
+	"[quantum] Time slice [ticks]        ",
+	"[tickless] Tickless idle [on|off]   ",
+	"[ps] Process table stats            ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -583,6 +843,17 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "sw",         cmd_swapstats },
+	{ "tlb",        cmd_tlbstats },
+	{ "pc",         cmd_pagecachestats },
+	{ "ksm",        cmd_ksmstats },
+	{ "fa",         cmd_clusterstats },
+	{ "mem",        cmd_memstats },
+	{ "vs",         cmd_vmstats },
+	{ "spl",        cmd_splstats },
+	{ "quantum",    cmd_quantum },
+	{ "tickless",   cmd_tickless },
+	{ "ps",         cmd_pidstats },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -596,11 +867,16 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	latencybench },
+	{ "tt5",	forkexitbench },
+	{ "tt6",	failexectest },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	sleeptest },
+	{ "sy5",	timedtest },
 
 	/* file system assignment tests */
 	{ "fs1",	fstest },
@@ -609,6 +885,13 @@ static struct {
 	{ "fs4",	writestress2 },
 	{ "fs5",	createstress },
 
+	/* vm benchmarks */
+	{ "vm1",	ptbench },
+	{ "vm2",	forkbench },
+	{ "vm3",	ctxbench },
+	{ "vm4",	mmapbench },
+	{ "vm5",	tlbbench },
+
 	{ NULL, NULL }
 };
 
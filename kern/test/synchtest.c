@@ -3,16 +3,21 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <synch.h>
 #include <thread.h>
 #include <test.h>
 #include <clock.h>
+#include <timer.h>
+#include <machine/spl.h>
 
 #define NSEMLOOPS     63
 #define NLOCKLOOPS    120
 #define NCVLOOPS      5
 #define NTHREADS      32
+#define NSLEEPERS     500
+#define NPINGPONGS    1000
 
 static volatile unsigned long testval1;
 static volatile unsigned long testval2;
@@ -273,3 +278,212 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Wakeup with many sleepers. NSLEEPERS threads are parked, each on its
+ * own semaphore, while two threads ping-pong a pair of semaphores; then
+ * the parked threads are released one V() at a time. Both phases time
+ * wakeups that have to find their thread among all the sleepers.
+ */
+
+static struct semaphore *pingsem;
+static struct semaphore *pongsem;
+static volatile int parked;
+
+static
+void
+parkedthread(void *sem, unsigned long num)
+{
+	int spl;
+
+	(void)num;
+
+	spl = splhigh();
+	parked++;
+	splx(spl);
+	P(sem);
+	V(donesem);
+}
+
+static
+void
+pongthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NPINGPONGS; i++) {
+		P(pingsem);
+		V(pongsem);
+	}
+	V(donesem);
+}
+
+int
+sleeptest(int nargs, char **args)
+{
+	struct semaphore **sems;
+	time_t secs, secs2;
+	u_int32_t nsecs, nsecs2, pingusecs, releaseusecs;
+	int i, n, result;
+
+	if (nargs > 2) {
+		kprintf("Usage: sy4 [sleepthreads]\n");
+		return 1;
+	}
+	n = nargs==2 ? atoi(args[1]) : NSLEEPERS;
+	if (n <= 0) {
+		kprintf("sy4: need at least one sleeper\n");
+		return 1;
+	}
+
+	inititems();
+	if (pingsem==NULL) {
+		pingsem = sem_create("ping", 0);
+		pongsem = sem_create("pong", 0);
+		if (pingsem == NULL || pongsem == NULL) {
+			panic("synchtest: sem_create failed\n");
+		}
+	}
+	sems = kmalloc(n * sizeof(struct semaphore *));
+	if (sems == NULL) {
+		kprintf("sy4: out of memory\n");
+		return 1;
+	}
+
+	kprintf("Starting many-sleeper test (%d sleepers)...\n", n);
+	parked = 0;
+	for (i=0; i<n; i++) {
+		sems[i] = sem_create("parked", 0);
+		if (sems[i] == NULL) {
+			panic("sleeptest: sem_create failed\n");
+		}
+		result = thread_fork("parked", sems[i], i, parkedthread,
+				     NULL);
+		if (result) {
+			panic("sleeptest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	/* Let them all get to their P. */
+	while (parked < n) {
+		thread_yield();
+	}
+	thread_yield();
+
+	result = thread_fork("pong", NULL, 0, pongthread, NULL);
+	if (result) {
+		panic("sleeptest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	gettime(&secs, &nsecs);
+	for (i=0; i<NPINGPONGS; i++) {
+		V(pingsem);
+		P(pongsem);
+	}
+	gettime(&secs2, &nsecs2);
+	pingusecs = getinterval_usecs(secs, nsecs, secs2, nsecs2);
+	P(donesem);
+
+	gettime(&secs, &nsecs);
+	for (i=0; i<n; i++) {
+		V(sems[i]);
+	}
+	gettime(&secs2, &nsecs2);
+	releaseusecs = getinterval_usecs(secs, nsecs, secs2, nsecs2);
+	for (i=0; i<n; i++) {
+		P(donesem);
+	}
+
+	for (i=0; i<n; i++) {
+		sem_destroy(sems[i]);
+	}
+	kfree(sems);
+
+	kprintf("%d ping-pongs: %lu us (%lu us each)\n", NPINGPONGS,
+		(unsigned long) pingusecs,
+		(unsigned long) (pingusecs / NPINGPONGS));
+	kprintf("Releasing %d sleepers: %lu us\n", n,
+		(unsigned long) releaseusecs);
+	kprintf("Many-sleeper test done.\n");
+	return 0;
+}
+
+/*
+ * Timed waits. Each wait below can only end by timing out; check that
+ * it does, and that it took at least as long as asked.
+ */
+
+#define TIMEDWAIT_MS  100
+
+static
+int
+timedcheck(const char *what, int result, time_t secs, u_int32_t nsecs)
+{
+	time_t secs2;
+	u_int32_t nsecs2, usecs;
+
+	gettime(&secs2, &nsecs2);
+	usecs = getinterval_usecs(secs, nsecs, secs2, nsecs2);
+
+	kprintf("%s: %s after %lu us\n", what,
+		result ? strerror(result) : "no timeout",
+		(unsigned long) usecs);
+	if (result != ETIMEDOUT || usecs < TIMEDWAIT_MS * 1000) {
+		kprintf("%s: FAILED\n", what);
+		return 1;
+	}
+	return 0;
+}
+
+int
+timedtest(int nargs, char **args)
+{
+	time_t secs;
+	u_int32_t nsecs;
+	int result, failed = 0;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting timed wait test...\n");
+
+	/* testsem starts at 2; take both so the next P has to wait. */
+	P(testsem);
+	P(testsem);
+	gettime(&secs, &nsecs);
+	result = P_timeout(testsem, TIMEDWAIT_MS);
+	failed += timedcheck("P_timeout", result, secs, nsecs);
+	V(testsem);
+	if (P_timeout(testsem, TIMEDWAIT_MS) != 0) {
+		kprintf("P_timeout on an available semaphore: FAILED\n");
+		failed++;
+	}
+	V(testsem);
+	V(testsem);
+
+	lock_acquire(testlock);
+	gettime(&secs, &nsecs);
+	result = lock_acquire_timeout(testlock, TIMEDWAIT_MS);
+	failed += timedcheck("lock_acquire_timeout", result, secs, nsecs);
+
+	gettime(&secs, &nsecs);
+	result = cv_wait_timeout(testcv, testlock, TIMEDWAIT_MS);
+	failed += timedcheck("cv_wait_timeout", result, secs, nsecs);
+	if (!lock_do_i_hold(testlock)) {
+		kprintf("cv_wait_timeout did not re-acquire the lock: "
+			"FAILED\n");
+		failed++;
+	}
+	lock_release(testlock);
+
+	gettime(&secs, &nsecs);
+	timer_sleep(timer_ms2ticks(TIMEDWAIT_MS));
+	failed += timedcheck("timer_sleep", ETIMEDOUT, secs, nsecs);
+
+	kprintf("Timed wait test %s.\n", failed ? "FAILED" : "done");
+	return failed ? 1 : 0;
+}
@@ -2,13 +2,18 @@
  * More thread test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
 #include <machine/spl.h>
 #include <synch.h>
 #include <thread.h>
 #include <test.h>
+#include <curthread.h>
+#include <pid.h>
 
 #include "opt-synchprobs.h"
+#include "opt-mlfq.h"
 
 /* dimension of matrices (cannot be too large or will overflow stack) */
 
@@ -229,3 +234,313 @@ threadtest3(int nargs, char **args)
 	}
 	return 0;
 }
+
+/*
+ * Wakeup latency benchmark.
+ *
+ * Spinner threads burn the CPU without ever sleeping while the menu
+ * thread wakes a set of sleeper threads one at a time and measures how
+ * long each takes to actually run after its V(). With round-robin every
+ * wakeup waits behind the spinners; with MLFQ the spinners sink to the
+ * low levels and the sleeper should run right away.
+ */
+
+#define LATENCY_ROUNDS 25	/* wakeups per sleeper */
+
+static volatile int spinnersdone;
+static struct semaphore *latgo, *latack;
+static time_t latsecs;
+static u_int32_t latnsecs;
+static u_int32_t lattotal, latmax;
+
+static
+void
+spinner_thread(void *junk1, unsigned long junk2)
+{
+	volatile u_int32_t x = 0;
+
+	(void)junk1;
+	(void)junk2;
+
+	while (!spinnersdone) {
+		x++;
+	}
+	V(donesem);
+}
+
+static
+void
+latsleeper_thread(void *junk1, unsigned long junk2)
+{
+	time_t secs;
+	u_int32_t nsecs, usecs;
+	int i;
+
+	(void)junk1;
+	(void)junk2;
+
+	for (i=0; i<LATENCY_ROUNDS; i++) {
+		P(latgo);
+		gettime(&secs, &nsecs);
+		usecs = getinterval_usecs(latsecs, latnsecs, secs, nsecs);
+		lattotal += usecs;
+		if (usecs > latmax) {
+			latmax = usecs;
+		}
+		V(latack);
+	}
+	V(donesem);
+}
+
+static
+void
+runlatency(int nsleepers, int nspinners)
+{
+	char name[16];
+	int i, result, nwakes;
+
+	setup();
+	if (latgo == NULL) {
+		latgo = sem_create("latgo", 0);
+		latack = sem_create("latack", 0);
+		if (latgo == NULL || latack == NULL) {
+			panic("latency bench: sem_create failed\n");
+		}
+	}
+	spinnersdone = 0;
+	lattotal = latmax = 0;
+
+	kprintf("Wakeup latency bench (%d sleepers, %d spinners, %s)\n",
+		nsleepers, nspinners,
+#if OPT_MLFQ
+		"MLFQ"
+#else
+		"round-robin"
+#endif
+		);
+
+	for (i=0; i<nspinners; i++) {
+		snprintf(name, sizeof(name), "spinner%d", i);
+		result = thread_fork(name, NULL, i, spinner_thread, NULL);
+		if (result) {
+			panic("thread_fork failed: %s\n", strerror(result));
+		}
+	}
+	for (i=0; i<nsleepers; i++) {
+		snprintf(name, sizeof(name), "latsleeper%d", i);
+		result = thread_fork(name, NULL, i, latsleeper_thread, NULL);
+		if (result) {
+			panic("thread_fork failed: %s\n", strerror(result));
+		}
+	}
+
+	/* One wakeup in flight at a time, so each is timed on its own. */
+	nwakes = nsleepers * LATENCY_ROUNDS;
+	for (i=0; i<nwakes; i++) {
+		gettime(&latsecs, &latnsecs);
+		V(latgo);
+		P(latack);
+	}
+
+	spinnersdone = 1;
+	for (i=0; i<nsleepers+nspinners; i++) {
+		P(donesem);
+	}
+
+	kprintf("%d wakeups: average %lu us, worst %lu us\n", nwakes,
+		(unsigned long) (nwakes ? lattotal / nwakes : 0),
+		(unsigned long) latmax);
+}
+
+int
+latencybench(int nargs, char **args)
+{
+	if (nargs==1) {
+		runlatency(4, 4);
+	}
+	else if (nargs==3) {
+		runlatency(atoi(args[1]), atoi(args[2]));
+	}
+	else {
+		kprintf("Usage: tt4 [sleepthreads spinthreads]\n");
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Fork+exit benchmark.
+ *
+ * Forks threads that exit straight away, one at a time, and times the
+ * round trips, first with the thread shell cache at its usual size and
+ * then with it turned off, so every fork goes to the allocator.
+ */
+
+#define FORKEXIT_ROUNDS 2000
+
+static
+void
+forkexit_thread(void *junk1, unsigned long junk2)
+{
+	(void)junk1;
+	(void)junk2;
+
+	V(donesem);
+}
+
+static
+void
+forkexit_run(const char *what, int rounds)
+{
+	time_t s1, s2;
+	u_int32_t ns1, ns2, usecs, msecs;
+	int i, result;
+
+	gettime(&s1, &ns1);
+	for (i=0; i<rounds; i++) {
+		result = thread_fork("forkexit", NULL, i, forkexit_thread, NULL);
+		if (result) {
+			panic("thread_fork failed: %s\n", strerror(result));
+		}
+		P(donesem);
+	}
+	gettime(&s2, &ns2);
+
+	usecs = getinterval_usecs(s1, ns1, s2, ns2);
+	msecs = usecs / 1000;
+	kprintf("%s: %d fork+exits, %lu us each, %lu per second\n", what,
+		rounds, (unsigned long) (usecs / rounds),
+		(unsigned long) (msecs ? rounds * 1000 / msecs : 0));
+}
+
+static
+void
+runforkexit(int rounds)
+{
+	int oldmax;
+
+	setup();
+
+	/* Start with a shell in the cache so the first fork is not a miss */
+	forkexit_run("warmup", 1);
+	forkexit_run("cache on ", rounds);
+
+	oldmax = thread_setshells(0);
+	forkexit_run("cache off", rounds);
+	thread_setshells(oldmax);
+
+	thread_printstats();
+}
+
+int
+forkexitbench(int nargs, char **args)
+{
+	if (nargs==1) {
+		runforkexit(FORKEXIT_ROUNDS);
+	}
+	else if (nargs==2 && atoi(args[1]) > 0) {
+		runforkexit(atoi(args[1]));
+	}
+	else {
+		kprintf("Usage: tt5 [rounds]\n");
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Waiting for a program that fails to start.
+ *
+ * Does what the menu's "p" does with a program that does not exist:
+ * fork a thread that tries to run it, and wait for it. Once with the
+ * wait already going when the child fails, once with the child gone
+ * before the wait starts. Either way the wait has to come back with
+ * the child's exit code.
+ */
+
+static
+void
+failexec_thread(void *gosem, unsigned long junk)
+{
+	char progname[] = "/testbin/no-such-program";
+	char *args[2];
+	int result;
+
+	(void)junk;
+
+	if (gosem != NULL) {
+		P(gosem);
+	}
+	args[0] = progname;
+	args[1] = NULL;
+	result = runprogram(progname, args, 1);
+	pid_setexitcode(curthread->pid, result);
+	thread_exit();
+}
+
+static
+int
+failexec_one(int waitfirst)
+{
+	struct semaphore *go = NULL;
+	struct thread *child;
+	int pid, status, result, spl;
+
+	if (waitfirst) {
+		go = sem_create("failexec", 0);
+		if (go == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	/* Interrupts off so the child cannot run (and exit) before we have its PID */
+	spl = splhigh();
+	result = thread_fork("failexec", go, 0, failexec_thread, &child);
+	if (result) {
+		splx(spl);
+		return result;
+	}
+	pid = child->pid;
+	splx(spl);
+
+	if (waitfirst) {
+		/* It fails once we are asleep in pid_wait */
+		V(go);
+	}
+	else {
+		clocksleep(1);
+	}
+
+	status = 0;
+	result = pid_wait(pid, &status);
+	if (go != NULL) {
+		sem_destroy(go);
+	}
+	if (result) {
+		return result;
+	}
+	kprintf("  %s: pid %d exited with \"%s\"\n",
+		waitfirst ? "wait first" : "exit first", pid, strerror(status));
+	return status != 0 ? 0 : EINVAL;
+}
+
+int
+failexectest(int nargs, char **args)
+{
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting failed-program wait test...\n");
+	result = failexec_one(1);
+	if (result == 0) {
+		result = failexec_one(0);
+	}
+	if (result) {
+		kprintf("failexectest: %s\n", strerror(result));
+		return result;
+	}
+	kprintf("Failed-program wait test done.\n");
+	return 0;
+}
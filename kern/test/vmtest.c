@@ -0,0 +1,683 @@
+/*
+ * Benchmarks for the VM system.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <curthread.h>
+#include <vm.h>
+#include <addrspace.h>
+#include <pagetable.h>
+#include <machine/tlb.h>
+#include <kern/unistd.h>
+#include <kern/stat.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <test.h>
+
+/*
+ * Helper: nanoseconds per operation without overflowing 32 bits.
+ */
+static
+u_int32_t
+per_op_nsecs(u_int32_t usecs, u_int32_t nops)
+{
+	return (usecs / nops) * 1000 + ((usecs % nops) * 1000) / nops;
+}
+
+/*
+ * Helper: a scratch address space whose heap is NPAGES resident pages
+ * starting at BASE. Returns NULL if out of memory. Free it with
+ * as_destroy.
+ */
+static
+struct addrspace *
+bench_space(vaddr_t base, int npages)
+{
+	struct addrspace *as;
+	paddr_t pa;
+	int i;
+
+	as = as_create();
+	if (as == NULL) {
+		return NULL;
+	}
+	as->heap.vbase = base;
+	as->heap.vend = base + npages*PAGE_SIZE;
+	for (i=0; i<npages; i++) {
+		if (createEntry(as, &as->heap, base + i*PAGE_SIZE, &pa)) {
+			as_destroy(as);
+			return NULL;
+		}
+		userPageReady(pa, as, base + i*PAGE_SIZE);
+	}
+	return as;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Page table fault-latency benchmark.
+//
+// Times the page table search vm_fault does on every TLB miss, with
+// 10, 100 and 1000 resident pages. For comparison the same lookups
+// are also done against a singly linked list of entries, which is how
+// regions kept their pages before the two-level table.
+//
+
+#define PTBENCH_LOOKUPS  5000
+#define PTBENCH_BASE     0x10000000
+
+static const int ptbench_sizes[] = { 10, 100, 1000 };
+#define PTBENCH_NSIZES (sizeof(ptbench_sizes)/sizeof(ptbench_sizes[0]))
+
+struct listentry {
+	vaddr_t vaddr;
+	paddr_t paddr;
+	struct listentry *next;
+};
+
+static
+paddr_t
+list_find(struct listentry *list, vaddr_t vaddr)
+{
+	while (list != NULL) {
+		if (vaddr >= list->vaddr && vaddr < list->vaddr + PAGE_SIZE) {
+			return list->paddr + vaddr - list->vaddr;
+		}
+		list = list->next;
+	}
+	return 0;
+}
+
+static
+int
+ptbench_one(int npages)
+{
+	PageTable *pt;
+	struct listentry *list = NULL, *le;
+	time_t s1, s2;
+	u_int32_t ns1, ns2, ptusecs, listusecs;
+	volatile paddr_t sink = 0;
+	int i, idx;
+
+	pt = pt_create();
+	if (pt == NULL) {
+		return ENOMEM;
+	}
+
+	/*
+	 * The frames are made up; nothing is ever read through them,
+	 * and pt_destroy does not touch the coremap.
+	 */
+	for (i=0; i<npages; i++) {
+		vaddr_t va = PTBENCH_BASE + i*PAGE_SIZE;
+		paddr_t pa = (i+1)*PAGE_SIZE;
+
+		le = kmalloc(sizeof(struct listentry));
+		if (le == NULL || pt_insert(pt, va, pa | TLBLO_VALID)) {
+			kfree(le);
+			pt_destroy(pt);
+			while (list != NULL) {
+				le = list->next;
+				kfree(list);
+				list = le;
+			}
+			return ENOMEM;
+		}
+		le->vaddr = va;
+		le->paddr = pa;
+		le->next = list;
+		list = le;
+	}
+
+	/* Two-level table */
+	idx = 0;
+	gettime(&s1, &ns1);
+	for (i=0; i<PTBENCH_LOOKUPS; i++) {
+		idx = (idx + 7919) % npages;
+		sink = findAddress(pt, PTBENCH_BASE + idx*PAGE_SIZE);
+	}
+	gettime(&s2, &ns2);
+	ptusecs = getinterval_usecs(s1, ns1, s2, ns2);
+
+	/* Linked list, same access pattern */
+	idx = 0;
+	gettime(&s1, &ns1);
+	for (i=0; i<PTBENCH_LOOKUPS; i++) {
+		idx = (idx + 7919) % npages;
+		sink = list_find(list, PTBENCH_BASE + idx*PAGE_SIZE);
+	}
+	gettime(&s2, &ns2);
+	listusecs = getinterval_usecs(s1, ns1, s2, ns2);
+
+	(void)sink;
+
+	kprintf("  %4d pages: two-level %6lu ns/lookup, list %8lu ns/lookup\n",
+		npages,
+		(unsigned long) per_op_nsecs(ptusecs, PTBENCH_LOOKUPS),
+		(unsigned long) per_op_nsecs(listusecs, PTBENCH_LOOKUPS));
+
+	pt_destroy(pt);
+	while (list != NULL) {
+		le = list->next;
+		kfree(list);
+		list = le;
+	}
+	return 0;
+}
+
+int
+ptbench(int nargs, char **args)
+{
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting page table fault-latency benchmark...\n");
+	for (i=0; i<PTBENCH_NSIZES; i++) {
+		result = ptbench_one(ptbench_sizes[i]);
+		if (result) {
+			kprintf("ptbench: %s\n", strerror(result));
+			return result;
+		}
+	}
+	kprintf("Page table benchmark done.\n");
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Fork (as_copy) benchmark.
+//
+// Builds an address space with N resident heap pages and times
+// as_copy, which is what sys_fork spends its time in, along with how
+// many pages it shared and copied. The eager line times what as_copy
+// used to do: allocate and memmove every resident page.
+//
+
+#define FORKBENCH_ITERS  20
+#define FORKBENCH_BASE   0x10000000
+
+static const int forkbench_sizes[] = { 16, 64, 128 };
+#define FORKBENCH_NSIZES (sizeof(forkbench_sizes)/sizeof(forkbench_sizes[0]))
+
+static
+int
+forkbench_one(int npages)
+{
+	struct addrspace *as, *child;
+	paddr_t *copies;
+	time_t s1, s2;
+	u_int32_t ns1, ns2, cowusecs, eagerusecs;
+	unsigned long shared, copied;
+	int i, j, result;
+
+	as = bench_space(FORKBENCH_BASE, npages);
+	if (as == NULL) {
+		return ENOMEM;
+	}
+	copies = kmalloc(npages * sizeof(paddr_t));
+	if (copies == NULL) {
+		as_destroy(as);
+		return ENOMEM;
+	}
+
+	/* Copy-on-write as_copy */
+	shared = cow_pages_shared;
+	copied = cow_pages_copied;
+	gettime(&s1, &ns1);
+	for (i=0; i<FORKBENCH_ITERS; i++) {
+		result = as_copy(as, &child);
+		if (result) {
+			kfree(copies);
+			as_destroy(as);
+			return result;
+		}
+		as_destroy(child);
+	}
+	gettime(&s2, &ns2);
+	cowusecs = getinterval_usecs(s1, ns1, s2, ns2);
+	shared = cow_pages_shared - shared;
+	copied = cow_pages_copied - copied;
+
+	/* Eager copy of every resident page */
+	gettime(&s1, &ns1);
+	for (i=0; i<FORKBENCH_ITERS; i++) {
+		for (j=0; j<npages; j++) {
+			copies[j] = getppages(1);
+			if (copies[j] == 0) {
+				while (--j >= 0) {
+					releasePage(copies[j]);
+				}
+				kfree(copies);
+				as_destroy(as);
+				return ENOMEM;
+			}
+			memmove((void *)PADDR_TO_KVADDR(copies[j]),
+				(const void *)PADDR_TO_KVADDR(findAddress(as->pagetable,
+					FORKBENCH_BASE + j*PAGE_SIZE)),
+				PAGE_SIZE);
+		}
+		for (j=0; j<npages; j++) {
+			releasePage(copies[j]);
+		}
+	}
+	gettime(&s2, &ns2);
+	eagerusecs = getinterval_usecs(s1, ns1, s2, ns2);
+
+	kprintf("  %4d pages: cow %6lu us/fork (%lu shared, %lu copied per fork), "
+		"eager %6lu us/fork (%d copied per fork)\n",
+		npages,
+		(unsigned long) (cowusecs / FORKBENCH_ITERS),
+		shared / FORKBENCH_ITERS, copied / FORKBENCH_ITERS,
+		(unsigned long) (eagerusecs / FORKBENCH_ITERS),
+		npages);
+
+	kfree(copies);
+	as_destroy(as);
+	return 0;
+}
+
+int
+forkbench(int nargs, char **args)
+{
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting fork benchmark...\n");
+	for (i=0; i<FORKBENCH_NSIZES; i++) {
+		result = forkbench_one(forkbench_sizes[i]);
+		if (result) {
+			kprintf("forkbench: %s\n", strerror(result));
+			return result;
+		}
+	}
+	kprintf("Fork benchmark done.\n");
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Context-switch TLB benchmark.
+//
+// Round-robins between a few address spaces whose working sets fit in
+// the TLB together, touching every page after each switch, and counts
+// TLB refills per switch. With ASID tagging the entries survive the
+// switches; the flush line invalidates the whole TLB on every switch,
+// which is what as_activate used to do.
+//
+
+#define CTXBENCH_SPACES  4
+#define CTXBENCH_PAGES   8
+#define CTXBENCH_ROUNDS  50
+#define CTXBENCH_BASE    0x10000000
+
+static
+void
+ctxbench_run(struct addrspace **spaces, int flush,
+	     unsigned long *refills, u_int32_t *usecs)
+{
+	time_t s1, s2;
+	u_int32_t ns1, ns2;
+	volatile int sink = 0;
+	int r, k, p;
+
+	*refills = tlb_misses + tlb_fastrefills;
+	gettime(&s1, &ns1);
+	for (r=0; r<CTXBENCH_ROUNDS; r++) {
+		for (k=0; k<CTXBENCH_SPACES; k++) {
+			curthread->t_vmspace = spaces[k];
+			as_activate(spaces[k]);
+			if (flush) {
+				tlb_flush();
+			}
+			for (p=0; p<CTXBENCH_PAGES; p++) {
+				sink += *(volatile int *)(CTXBENCH_BASE + p*PAGE_SIZE);
+			}
+		}
+	}
+	gettime(&s2, &ns2);
+	*usecs = getinterval_usecs(s1, ns1, s2, ns2);
+	*refills = tlb_misses + tlb_fastrefills - *refills;
+	(void)sink;
+}
+
+int
+ctxbench(int nargs, char **args)
+{
+	struct addrspace *spaces[CTXBENCH_SPACES];
+	struct addrspace *saved;
+	unsigned long asidrefills, flushrefills;
+	u_int32_t asidusecs, flushusecs;
+	int nswitches = CTXBENCH_ROUNDS * CTXBENCH_SPACES;
+	int i;
+
+	(void)nargs;
+	(void)args;
+
+	for (i=0; i<CTXBENCH_SPACES; i++) {
+		spaces[i] = bench_space(CTXBENCH_BASE, CTXBENCH_PAGES);
+		if (spaces[i] == NULL) {
+			while (--i >= 0) {
+				as_destroy(spaces[i]);
+			}
+			kprintf("ctxbench: %s\n", strerror(ENOMEM));
+			return ENOMEM;
+		}
+	}
+
+	kprintf("Starting context-switch TLB benchmark...\n");
+
+	saved = curthread->t_vmspace;
+	ctxbench_run(spaces, 0, &asidrefills, &asidusecs);
+	ctxbench_run(spaces, 1, &flushrefills, &flushusecs);
+	curthread->t_vmspace = saved;
+	if (saved != NULL) {
+		as_activate(saved);
+	}
+
+	kprintf("  %d spaces x %d pages, %d switches\n",
+		CTXBENCH_SPACES, CTXBENCH_PAGES, nswitches);
+	kprintf("  asid:  %3lu.%02lu refills/switch, %6lu us/switch\n",
+		asidrefills / nswitches, (asidrefills * 100 / nswitches) % 100,
+		(unsigned long) (asidusecs / nswitches));
+	kprintf("  flush: %3lu.%02lu refills/switch, %6lu us/switch\n",
+		flushrefills / nswitches, (flushrefills * 100 / nswitches) % 100,
+		(unsigned long) (flushusecs / nswitches));
+
+	for (i=0; i<CTXBENCH_SPACES; i++) {
+		as_destroy(spaces[i]);
+	}
+	kprintf("Context-switch benchmark done.\n");
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// mmap vs read scan benchmark.
+//
+// Sums every word of a file two ways from inside a scratch address
+// space: read-scan copies it through the kernel into a user buffer a
+// chunk at a time, the way read() does, and mmap-scan maps the file
+// privately and touches it in place. Each is run twice; the second
+// mmap pass finds the pages in the page cache and does no I/O or
+// copying at all.
+//
+
+#define MMAPBENCH_BUF    0x10000000
+#define MMAPBENCH_CHUNK  (4*PAGE_SIZE)
+
+static
+int
+mmapbench_read(struct vnode *v, struct addrspace *as, off_t size,
+	       u_int32_t *sum, u_int32_t *usecs)
+{
+	time_t s1, s2;
+	u_int32_t ns1, ns2;
+	struct uio u;
+	off_t pos;
+	size_t len, i;
+	int result;
+
+	*sum = 0;
+	gettime(&s1, &ns1);
+	for (pos=0; pos<size; pos+=len) {
+		len = (size - pos < MMAPBENCH_CHUNK) ? size - pos : MMAPBENCH_CHUNK;
+		u.uio_iovec.iov_ubase = (userptr_t)MMAPBENCH_BUF;
+		u.uio_iovec.iov_len = len;
+		u.uio_offset = pos;
+		u.uio_resid = len;
+		u.uio_segflg = UIO_USERSPACE;
+		u.uio_rw = UIO_READ;
+		u.uio_space = as;
+		result = VOP_READ(v, &u);
+		if (result) {
+			return result;
+		}
+		for (i=0; i+sizeof(u_int32_t)<=len; i+=sizeof(u_int32_t)) {
+			*sum += *(volatile u_int32_t *)(MMAPBENCH_BUF + i);
+		}
+	}
+	gettime(&s2, &ns2);
+	*usecs = getinterval_usecs(s1, ns1, s2, ns2);
+	return 0;
+}
+
+static
+int
+mmapbench_map(struct vnode *v, struct addrspace *as, off_t size,
+	      u_int32_t *sum, u_int32_t *usecs)
+{
+	time_t s1, s2;
+	u_int32_t ns1, ns2;
+	vaddr_t addr;
+	off_t i;
+	int result;
+
+	*sum = 0;
+	gettime(&s1, &ns1);
+	result = as_define_mapping(as, v, 0, size, size, REGION_READ, 0, &addr);
+	if (result) {
+		return result;
+	}
+	for (i=0; i+(off_t)sizeof(u_int32_t)<=size; i+=sizeof(u_int32_t)) {
+		*sum += *(volatile u_int32_t *)(addr + i);
+	}
+	result = as_removeregion(as, as_findregion(as, addr));
+	gettime(&s2, &ns2);
+	*usecs = getinterval_usecs(s1, ns1, s2, ns2);
+	return result;
+}
+
+static
+void
+mmapbench_print(const char *name, off_t size, u_int32_t usecs)
+{
+	kprintf("  %-10s %8lu us", name, (unsigned long) usecs);
+	if (usecs > 0) {
+		kprintf("  %6lu KB/s",
+			(unsigned long) (((u_int32_t)size / 1024) * 1000000 / usecs));
+	}
+	kprintf("\n");
+}
+
+int
+mmapbench(int nargs, char **args)
+{
+	char path[128];
+	struct addrspace *as, *saved;
+	struct vnode *v;
+	struct stat st;
+	u_int32_t readsum, mapsum, usecs[4];
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: vm4 file\n");
+		return EINVAL;
+	}
+
+	strcpy(path, args[1]);
+	result = vfs_open(path, O_RDONLY, &v);
+	if (result) {
+		kprintf("mmapbench: %s: %s\n", args[1], strerror(result));
+		return result;
+	}
+	result = VOP_STAT(v, &st);
+	if (result) {
+		vfs_close(v);
+		kprintf("mmapbench: %s\n", strerror(result));
+		return result;
+	}
+
+	as = as_create();
+	if (as == NULL) {
+		vfs_close(v);
+		kprintf("mmapbench: %s\n", strerror(ENOMEM));
+		return ENOMEM;
+	}
+	as->heap.vbase = MMAPBENCH_BUF;
+	as->heap.vend = MMAPBENCH_BUF + MMAPBENCH_CHUNK;
+
+	kprintf("Starting mmap benchmark on %s (%lu bytes)...\n",
+		args[1], (unsigned long) st.st_size);
+
+	saved = curthread->t_vmspace;
+	curthread->t_vmspace = as;
+	as_activate(as);
+
+	result = mmapbench_read(v, as, st.st_size, &readsum, &usecs[0]);
+	if (!result) result = mmapbench_read(v, as, st.st_size, &readsum, &usecs[1]);
+	if (!result) result = mmapbench_map(v, as, st.st_size, &mapsum, &usecs[2]);
+	if (!result) result = mmapbench_map(v, as, st.st_size, &mapsum, &usecs[3]);
+
+	curthread->t_vmspace = saved;
+	if (saved != NULL) {
+		as_activate(saved);
+	}
+	as_destroy(as);
+	vfs_close(v);
+
+	if (result) {
+		kprintf("mmapbench: %s\n", strerror(result));
+		return result;
+	}
+	if (readsum != mapsum) {
+		kprintf("mmapbench: checksums differ (read %lx, mmap %lx)\n",
+			(unsigned long) readsum, (unsigned long) mapsum);
+		return EINVAL;
+	}
+
+	mmapbench_print("read", st.st_size, usecs[0]);
+	mmapbench_print("read 2nd", st.st_size, usecs[1]);
+	mmapbench_print("mmap", st.st_size, usecs[2]);
+	mmapbench_print("mmap 2nd", st.st_size, usecs[3]);
+	kprintf("mmap benchmark done.\n");
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// TLB refill benchmark.
+//
+// Touches a set of resident pages right after flushing the TLB, so
+// every touch is a refill, once with the fast refill in the UTLB vector
+// and once with every miss going through vm_fault. The time for the
+// same touches with the TLB warm, and for the flushes alone, is taken
+// off, which leaves the cost of the refills themselves. Cycles assume
+// the processor runs at TLBBENCH_MHZ.
+//
+
+#define TLBBENCH_PAGES   32
+#define TLBBENCH_ROUNDS  200
+#define TLBBENCH_BASE    0x10000000
+#define TLBBENCH_MHZ     25	/* sys161 default */
+
+/*
+ * One timing loop: ROUNDS times, maybe flush the TLB, maybe touch
+ * every page.
+ */
+static
+u_int32_t
+tlbbench_loop(int flush, int touch)
+{
+	time_t s1, s2;
+	u_int32_t ns1, ns2;
+	volatile int sink = 0;
+	int r, p;
+
+	gettime(&s1, &ns1);
+	for (r=0; r<TLBBENCH_ROUNDS; r++) {
+		if (flush) {
+			tlb_flush();
+		}
+		if (touch) {
+			for (p=0; p<TLBBENCH_PAGES; p++) {
+				sink += *(volatile int *)(TLBBENCH_BASE + p*PAGE_SIZE);
+			}
+		}
+	}
+	gettime(&s2, &ns2);
+	(void)sink;
+	return getinterval_usecs(s1, ns1, s2, ns2);
+}
+
+static
+void
+tlbbench_run(struct addrspace *as, int fast, const char *name)
+{
+	unsigned long fastrefills, slowrefills;
+	u_int32_t missusecs, hitusecs, flushusecs, usecs, nsecs;
+	int nrefills = TLBBENCH_ROUNDS * TLBBENCH_PAGES;
+
+	utlb_fastpath = fast;
+	as_activate(as);
+
+	/* Warm up: get everything in the page table and the TLB */
+	tlbbench_loop(0, 1);
+
+	fastrefills = tlb_fastrefills;
+	slowrefills = tlb_misses;
+	missusecs = tlbbench_loop(1, 1);
+	fastrefills = tlb_fastrefills - fastrefills;
+	slowrefills = tlb_misses - slowrefills;
+
+	hitusecs = tlbbench_loop(0, 1);
+	flushusecs = tlbbench_loop(1, 0);
+
+	usecs = missusecs - hitusecs - flushusecs;
+	if (hitusecs + flushusecs > missusecs) {
+		usecs = 0;
+	}
+	nsecs = per_op_nsecs(usecs, nrefills);
+
+	kprintf("  %s: %5lu ns/refill (%4lu cycles), %lu fast + %lu vm_fault refills\n",
+		name, (unsigned long) nsecs,
+		(unsigned long) (nsecs * TLBBENCH_MHZ / 1000),
+		fastrefills, slowrefills);
+}
+
+int
+tlbbench(int nargs, char **args)
+{
+	struct addrspace *as, *saved;
+	int oldfast = utlb_fastpath;
+
+	(void)nargs;
+	(void)args;
+
+	as = bench_space(TLBBENCH_BASE, TLBBENCH_PAGES);
+	if (as == NULL) {
+		kprintf("tlbbench: %s\n", strerror(ENOMEM));
+		return ENOMEM;
+	}
+
+	kprintf("Starting TLB refill benchmark (%d pages x %d rounds)...\n",
+		TLBBENCH_PAGES, TLBBENCH_ROUNDS);
+
+	saved = curthread->t_vmspace;
+	curthread->t_vmspace = as;
+	tlbbench_run(as, 0, "vm_fault");
+	tlbbench_run(as, 1, "fast    ");
+
+	utlb_fastpath = oldfast;
+	curthread->t_vmspace = saved;
+	if (saved != NULL) {
+		as_activate(saved);
+	}
+	as_destroy(as);
+	kprintf("TLB refill benchmark done.\n");
+
+	return 0;
+}
@@ -2,7 +2,9 @@
 #include <lib.h>
 #include <machine/spl.h>
 #include <thread.h>
+#include <scheduler.h>
 #include <clock.h>
+#include <timer.h>
 
 /* 
  * The address of lbolt has thread_wakeup called on it once a second.
@@ -12,7 +14,153 @@ int lbolt;
 static int lbolt_counter;
 
 /*
- * This is called HZ times a second by the timer device setup.
+ * Tickless state. The timer driving hardclock, if it can be
+ * reprogrammed; whether the periodic tick is currently stopped; and
+ * when it stopped, with how many ticks since then already counted.
+ */
+int clock_tickless = 1;
+
+static void *clock_dev;
+static void (*clock_settimer)(void *, int, u_int32_t);
+static void (*clock_gettime)(void *, time_t *, u_int32_t *);
+
+static int tick_stopped;
+static time_t stop_secs;
+static u_int32_t stop_nsecs;
+static u_int32_t stop_ticks;
+
+static unsigned long clock_ticks, clock_skipped, clock_oneshots;
+
+#define USECS_PER_TICK  (1000000/HZ)
+
+void
+hardclock_attach(void *dev,
+		 void (*settimer)(void *dev, int periodic, u_int32_t usecs),
+		 void (*gettime)(void *dev, time_t *secs, u_int32_t *nsecs))
+{
+	clock_dev = dev;
+	clock_settimer = settimer;
+	clock_gettime = gettime;
+	clock_settimer(clock_dev, 1, USECS_PER_TICK);
+}
+
+/*
+ * Count the ticks that went by since the tick was stopped. This can
+ * run in the middle of a thread_wakeup, so it leaves delivering lbolt
+ * and running timers to hardclock.
+ */
+static
+void
+clock_catchup(void)
+{
+	time_t secs, rsecs;
+	u_int32_t nsecs, rnsecs, ticks;
+
+	clock_gettime(clock_dev, &secs, &nsecs);
+	getinterval(stop_secs, stop_nsecs, secs, nsecs, &rsecs, &rnsecs);
+	ticks = rsecs*HZ + rnsecs/(USECS_PER_TICK*1000);
+
+	lbolt_counter += ticks - stop_ticks;
+	clock_skipped += ticks - stop_ticks;
+	timer_advance(ticks - stop_ticks);
+	stop_ticks = ticks;
+}
+
+/*
+ * Wake lbolt sleepers if a second's worth of ticks has gone by.
+ */
+static
+void
+clock_lbolt(void)
+{
+	if (lbolt_counter >= HZ) {
+		lbolt_counter %= HZ;
+		thread_wakeup(&lbolt);
+	}
+}
+
+/*
+ * Set the one-shot for the next lbolt or the next kernel timer,
+ * whichever comes first.
+ */
+static
+void
+clock_arm(void)
+{
+	u_int32_t ticks, next;
+
+	ticks = lbolt_counter < HZ ? HZ - lbolt_counter : 1;
+	next = timer_next();
+	if (next != 0 && next < ticks) {
+		ticks = next;
+	}
+
+	clock_settimer(clock_dev, 0, ticks * USECS_PER_TICK);
+	clock_oneshots++;
+}
+
+void
+clock_stoptick(void)
+{
+	assert(curspl>0);
+
+	if (tick_stopped || !clock_tickless || clock_settimer == NULL) {
+		return;
+	}
+	tick_stopped = 1;
+	clock_gettime(clock_dev, &stop_secs, &stop_nsecs);
+	stop_ticks = 0;
+	clock_arm();
+}
+
+void
+clock_starttick(void)
+{
+	assert(curspl>0);
+
+	if (!tick_stopped) {
+		return;
+	}
+	tick_stopped = 0;
+	clock_settimer(clock_dev, 1, USECS_PER_TICK);
+	clock_catchup();
+}
+
+void
+clock_sync(void)
+{
+	assert(curspl>0);
+
+	if (tick_stopped) {
+		clock_catchup();
+	}
+}
+
+void
+clock_rearm(void)
+{
+	assert(curspl>0);
+
+	if (tick_stopped) {
+		clock_arm();
+	}
+}
+
+void
+clock_printstats(void)
+{
+	kprintf("Clock: %u hz, tickless %s (tick %s)\n", HZ,
+		clock_tickless ? "on" : "off",
+		tick_stopped ? "stopped" : "running");
+	kprintf("       %lu ticks taken, %lu skipped, %lu one-shots\n",
+		clock_ticks, clock_skipped, clock_oneshots);
+	timer_printstats();
+}
+
+/*
+ * This is called HZ times a second by the timer device setup, or, with
+ * the tick stopped, when the one-shot for the next lbolt or kernel
+ * timer goes off.
  */
 
 void
@@ -22,14 +170,27 @@ hardclock(void)
 	 * Collect statistics here as desired.
 	 */
 
+	if (tick_stopped) {
+		clock_catchup();
+		clock_lbolt();
+		timer_run();
+		/* Waking sleepers can start the tick again. */
+		if (tick_stopped) {
+			clock_arm();
+		}
+		return;
+	}
 
+	clock_ticks++;
 	lbolt_counter++;
-	if (lbolt_counter >= HZ) {
-		lbolt_counter = 0;
-		thread_wakeup(&lbolt);
-	}
+	clock_lbolt();
+	timer_advance(1);
+	timer_run();
 
-	thread_yield();
+	/* The scheduler decides whether this tick ends the time slice. */
+	if (scheduler_tick()) {
+		thread_yield();
+	}
 }
 
 /*
@@ -1,34 +1,81 @@
 /*
  * Scheduler.
  *
- * The default scheduler is very simple, just a round-robin run queue.
- * You'll want to improve it.
+ * The default scheduler is very simple, just a round-robin run queue
+ * with a context switch every sched_quantum clock ticks.
+ *
+ * With "options mlfq" it is a multi-level feedback queue instead:
+ * MLFQ_LEVELS run queues, highest priority (level 0) first. A thread
+ * that uses up its level's quantum moves down a level, and one that
+ * goes to sleep and is woken moves up a level, so threads waiting on
+ * the console or the disk run ahead of the ones computing. Every
+ * MLFQ_BOOST ticks everything runnable goes back to level 0 so CPU-bound
+ * threads cannot starve.
  */
 
 #include <types.h>
 #include <lib.h>
 #include <scheduler.h>
 #include <thread.h>
+#include <curthread.h>
+#include <clock.h>
 #include <machine/spl.h>
 #include <queue.h>
+#include <vm.h>
+#include "opt-mlfq.h"
 
 /*
  *  Scheduler data
  */
 
+// Clock ticks in a time slice (set with the "quantum" menu command)
+int sched_quantum = 1;
+
+#if OPT_MLFQ
+
+#define MLFQ_LEVELS 4
+#define MLFQ_BOOST  HZ		/* ticks between priority boosts */
+
+// Time slices a thread runs at each level before being demoted
+static const int mlfq_quantum[MLFQ_LEVELS] = { 1, 2, 4, 8 };
+
+// Queues of runnable threads, one per level
+static struct queue *runqueues[MLFQ_LEVELS];
+
+// Ticks since the last priority boost
+static int boost_counter;
+
+// Counters for print_run_queue
+static unsigned long mlfq_demotions, mlfq_promotions, mlfq_boosts;
+
+#else
+
 // Queue of runnable threads
 static struct queue *runqueue;
 
+#endif /* OPT_MLFQ */
+
 /*
  * Setup function
  */
 void
 scheduler_bootstrap(void)
 {
+#if OPT_MLFQ
+	int i;
+
+	for (i=0; i<MLFQ_LEVELS; i++) {
+		runqueues[i] = q_create(32);
+		if (runqueues[i] == NULL) {
+			panic("scheduler: Could not create run queue\n");
+		}
+	}
+#else
 	runqueue = q_create(32);
 	if (runqueue == NULL) {
 		panic("scheduler: Could not create run queue\n");
 	}
+#endif
 }
 
 /*
@@ -42,7 +89,22 @@ int
 scheduler_preallocate(int nthreads)
 {
 	assert(curspl>0);
+#if OPT_MLFQ
+	{
+		/* Every thread could end up on the same level. */
+		int i, result;
+
+		for (i=0; i<MLFQ_LEVELS; i++) {
+			result = q_preallocate(runqueues[i], nthreads);
+			if (result) {
+				return result;
+			}
+		}
+		return 0;
+	}
+#else
 	return q_preallocate(runqueue, nthreads);
+#endif
 }
 
 /*
@@ -55,10 +117,24 @@ void
 scheduler_killall(void)
 {
 	assert(curspl>0);
+#if OPT_MLFQ
+	{
+		int i;
+
+		for (i=0; i<MLFQ_LEVELS; i++) {
+			while (!q_empty(runqueues[i])) {
+				struct thread *t = q_remhead(runqueues[i]);
+				kprintf("scheduler: Dropping thread %s.\n",
+					t->t_name);
+			}
+		}
+	}
+#else
 	while (!q_empty(runqueue)) {
 		struct thread *t = q_remhead(runqueue);
 		kprintf("scheduler: Dropping thread %s.\n", t->t_name);
 	}
+#endif
 }
 
 /*
@@ -74,9 +150,65 @@ scheduler_shutdown(void)
 	scheduler_killall();
 
 	assert(curspl>0);
+#if OPT_MLFQ
+	{
+		int i;
+
+		for (i=0; i<MLFQ_LEVELS; i++) {
+			q_destroy(runqueues[i]);
+			runqueues[i] = NULL;
+		}
+	}
+#else
 	q_destroy(runqueue);
 	runqueue = NULL;
+#endif
+}
+
+#if OPT_MLFQ
+/*
+ * Return the highest (lowest-numbered) level with a runnable thread,
+ * or MLFQ_LEVELS if there is none.
+ */
+static
+int
+mlfq_toplevel(void)
+{
+	int i;
+
+	for (i=0; i<MLFQ_LEVELS && q_empty(runqueues[i]); i++);
+	return i;
+}
+
+/*
+ * Priority boost: put every runnable thread, and the current one,
+ * back at level 0 with a fresh quantum.
+ */
+static
+void
+mlfq_boost(void)
+{
+	int i;
+
+	for (i=1; i<MLFQ_LEVELS; i++) {
+		while (!q_empty(runqueues[i])) {
+			struct thread *t = q_remhead(runqueues[i]);
+			int result;
+
+			t->t_priority = 0;
+			t->t_ticks = 0;
+			/* Preallocated in scheduler_preallocate. */
+			result = q_addtail(runqueues[0], t);
+			assert(result == 0);
+		}
+	}
+	if (curthread != NULL) {
+		curthread->t_priority = 0;
+		curthread->t_ticks = 0;
+	}
+	mlfq_boosts++;
 }
+#endif /* OPT_MLFQ */
 
 /*
  * Actual scheduler. Returns the next thread to run.  Calls cpu_idle()
@@ -87,11 +219,30 @@ scheduler_shutdown(void)
 struct thread *
 scheduler(void)
 {
+	struct thread *next;
+	int others;
+
 	// meant to be called with interrupts off
 	assert(curspl>0);
 	
+#if OPT_MLFQ
+	while (mlfq_toplevel() == MLFQ_LEVELS) {
+#else
 	while (q_empty(runqueue)) {
-		cpu_idle();
+#endif
+		/*
+		 * Spare time goes to zeroing free pages ahead of need, a
+		 * page at a time with a chance for interrupts in between.
+		 * Only wait for an interrupt once there is nothing to do.
+		 */
+		if (vm_idle()) {
+			cpu_pollintr();
+		}
+		else {
+			/* Sleep until something happens, not until the next tick. */
+			clock_stoptick();
+			cpu_idle();
+		}
 	}
 
 	// You can actually uncomment this to see what the scheduler's
@@ -101,12 +252,29 @@ scheduler(void)
 	// 
 	//print_run_queue();
 	
-	return q_remhead(runqueue);
+#if OPT_MLFQ
+	next = q_remhead(runqueues[mlfq_toplevel()]);
+	others = mlfq_toplevel() < MLFQ_LEVELS;
+#else
+	next = q_remhead(runqueue);
+	next->t_ticks = 0;
+	others = !q_empty(runqueue);
+#endif
+
+	/* With nothing to switch to there is no point in ticking. */
+	if (others) {
+		clock_starttick();
+	}
+	else {
+		clock_stoptick();
+	}
+	return next;
 }
 
 /* 
  * Make a thread runnable.
  * With the base scheduler, just add it to the end of the run queue.
+ * With MLFQ, add it to the end of the queue for its level.
  */
 int
 make_runnable(struct thread *t)
@@ -114,7 +282,84 @@ make_runnable(struct thread *t)
 	// meant to be called with interrupts off
 	assert(curspl>0);
 
+	/* Something running now has competition, so it needs the tick. */
+	if (curthread != NULL) {
+		clock_starttick();
+	}
+
+#if OPT_MLFQ
+	assert(t->t_priority >= 0 && t->t_priority < MLFQ_LEVELS);
+	return q_addtail(runqueues[t->t_priority], t);
+#else
 	return q_addtail(runqueue, t);
+#endif
+}
+
+/*
+ * Called from hardclock on every tick. Returns nonzero if the current
+ * thread should give up the processor.
+ *
+ * The base scheduler switches every sched_quantum ticks. MLFQ charges
+ * the tick to the current thread and switches when its level's quantum
+ * is used up (demoting it) or when a higher-priority thread has become
+ * runnable.
+ */
+int
+scheduler_tick(void)
+{
+	assert(curspl>0);
+
+#if OPT_MLFQ
+	boost_counter++;
+	if (boost_counter >= MLFQ_BOOST) {
+		boost_counter = 0;
+		mlfq_boost();
+	}
+
+	/* Ticks that land in the idle loop belong to nobody. */
+	if (curthread == NULL) {
+		return 0;
+	}
+
+	curthread->t_ticks++;
+	if (curthread->t_ticks >=
+	    mlfq_quantum[curthread->t_priority] * sched_quantum) {
+		if (curthread->t_priority < MLFQ_LEVELS-1) {
+			curthread->t_priority++;
+			mlfq_demotions++;
+		}
+		curthread->t_ticks = 0;
+		return 1;
+	}
+	return mlfq_toplevel() < curthread->t_priority;
+#else
+	if (curthread == NULL) {
+		return 0;
+	}
+	curthread->t_ticks++;
+	return curthread->t_ticks >= sched_quantum;
+#endif
+}
+
+/*
+ * Called when thread T is woken up, before it is made runnable.
+ * With MLFQ a thread that slept is moved up a level with a fresh
+ * quantum; the base scheduler does nothing.
+ */
+void
+scheduler_wakeup(struct thread *t)
+{
+	assert(curspl>0);
+
+#if OPT_MLFQ
+	if (t->t_priority > 0) {
+		t->t_priority--;
+		mlfq_promotions++;
+	}
+	t->t_ticks = 0;
+#else
+	(void)t;
+#endif
 }
 
 /*
@@ -127,6 +372,27 @@ print_run_queue(void)
 	int spl = splhigh();
 
 	int i,k=0;
+#if OPT_MLFQ
+	int level;
+
+	for (level=0; level<MLFQ_LEVELS; level++) {
+		struct queue *runqueue = runqueues[level];
+
+		kprintf("level %d (quantum %d ticks):\n", level,
+			mlfq_quantum[level] * sched_quantum);
+		i = q_getstart(runqueue);
+		k = 0;
+		while (i!=q_getend(runqueue)) {
+			struct thread *t = q_getguy(runqueue, i);
+			kprintf("  %2d: %s %p\n", k, t->t_name,
+				t->t_sleepaddr);
+			i=(i+1)%q_getsize(runqueue);
+			k++;
+		}
+	}
+	kprintf("%lu demotions, %lu promotions, %lu boosts\n",
+		mlfq_demotions, mlfq_promotions, mlfq_boosts);
+#else
 	i = q_getstart(runqueue);
 	
 	while (i!=q_getend(runqueue)) {
@@ -135,6 +401,7 @@ print_run_queue(void)
 		i=(i+1)%q_getsize(runqueue);
 		k++;
 	}
+#endif
 	
 	splx(spl);
 }
@@ -4,16 +4,37 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <synch.h>
 #include <thread.h>
 #include <curthread.h>
 #include <machine/spl.h>
+#include <timer.h>
 
 ////////////////////////////////////////////////////////////
 //
 // Semaphore.
 
+/*
+ * Semaphores and locks come from object caches, made by
+ * synch_bootstrap before anything creates one.
+ */
+static struct kcache *sem_cache;
+static struct kcache *lock_cache;
+
+static void lock_ctor(void *obj);
+
+void
+synch_bootstrap(void)
+{
+	sem_cache = kcache_create("semaphore", sizeof(struct semaphore), NULL);
+	lock_cache = kcache_create("lock", sizeof(struct lock), lock_ctor);
+	if (sem_cache == NULL || lock_cache == NULL) {
+		panic("synch_bootstrap: cannot create object caches\n");
+	}
+}
+
 struct semaphore *
 sem_create(const char *namearg, int initial_count)
 {
@@ -21,14 +42,14 @@ sem_create(const char *namearg, int initial_count)
 
 	assert(initial_count >= 0);
 
-	sem = kmalloc(sizeof(struct semaphore));
+	sem = kcache_alloc(sem_cache);
 	if (sem == NULL) {
 		return NULL;
 	}
 
 	sem->name = kstrdup(namearg);
 	if (sem->name == NULL) {
-		kfree(sem);
+		kcache_free(sem_cache, sem);
 		return NULL;
 	}
 
@@ -56,7 +77,7 @@ sem_destroy(struct semaphore *sem)
 	 */
 
 	kfree(sem->name);
-	kfree(sem);
+	kcache_free(sem_cache, sem);
 }
 
 void 
@@ -82,6 +103,28 @@ P(struct semaphore *sem)
 	splx(spl);
 }
 
+int
+P_timeout(struct semaphore *sem, u_int32_t msecs)
+{
+	int spl, result = 0;
+	u_int32_t deadline;
+	assert(sem != NULL);
+	assert(in_interrupt==0);
+
+	spl = splhigh();
+	deadline = timer_deadline(msecs);
+	while (sem->count==0 && result==0) {
+		result = thread_sleep_until(sem, deadline);
+	}
+	if (sem->count > 0) {
+		/* A V that came in with the timeout still counts. */
+		sem->count--;
+		result = 0;
+	}
+	splx(spl);
+	return result;
+}
+
 void
 V(struct semaphore *sem)
 {
@@ -90,7 +133,8 @@ V(struct semaphore *sem)
 	spl = splhigh();
 	sem->count++;
 	assert(sem->count>0);
-	thread_wakeup(sem);
+	/* One more P can get through, so one sleeper is enough. */
+	thread_wakeone(sem);
 	splx(spl);
 }
 
@@ -98,25 +142,35 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * A lock in the cache is always unowned (lock_destroy leaves it that
+ * way), so this only has to happen once per lock.
+ */
+static
+void
+lock_ctor(void *obj)
+{
+	struct lock *lock = obj;
+	lock->owner = NULL;
+}
+
 struct lock *
 lock_create(const char *name)
 {
 	struct lock *lock;
 
-	lock = kmalloc(sizeof(struct lock));
+	// Owner is already NULL (see lock_ctor)
+	lock = kcache_alloc(lock_cache);
 	if (lock == NULL) {
 		return NULL;
 	}
 
 	lock->name = kstrdup(name);
 	if (lock->name == NULL) {
-		kfree(lock);
+		kcache_free(lock_cache, lock);
 		return NULL;
 	}
 	
-	// Initializing owner to NULL
-    lock->owner = NULL;
-	
 	return lock;
 }
 
@@ -128,7 +182,7 @@ lock_destroy(struct lock *lock)
 	// add stuff here as needed
 	lock->owner = NULL; //Don't want to delete curthread info (i.e. no kfree required)
 	kfree(lock->name);
-	kfree(lock);
+	kcache_free(lock_cache, lock);
 }
 
 void
@@ -151,6 +205,27 @@ lock_acquire(struct lock *lock)
 	//(void)lock;  // suppress warning until code gets written
 }
 
+int
+lock_acquire_timeout(struct lock *lock, u_int32_t msecs)
+{
+	int spl, result = 0;
+	u_int32_t deadline;
+	assert(lock != NULL);
+	assert(in_interrupt==0);
+	spl = splhigh();
+
+	deadline = timer_deadline(msecs);
+	while (lock->owner != NULL && result == 0) {
+		result = thread_sleep_until(lock, deadline);
+	}
+	if (lock->owner == NULL) {
+		lock->owner = curthread;
+		result = 0;
+	}
+	splx(spl);
+	return result;
+}
+
 void
 lock_release(struct lock *lock)
 {
@@ -162,7 +237,8 @@ lock_release(struct lock *lock)
 
     lock->owner = NULL;
     assert(lock->owner == NULL);
-    thread_wakeup(lock);
+    //Only one of them can get it; the rest would just go back to sleep
+    thread_wakeone(lock);
     splx(spl);
 
 	//(void)lock;  // suppress warning until code gets written
@@ -228,6 +304,19 @@ cv_wait(struct cv *cv, struct lock *lock)
     splx(spl);
 }
 
+int
+cv_wait_timeout(struct cv *cv, struct lock *lock, u_int32_t msecs)
+{
+    int spl, result;
+    assert((cv != NULL) && (lock != NULL));
+    spl = splhigh();
+    lock_release(lock);
+    result = thread_sleep_until(cv, timer_deadline(msecs));
+    lock_acquire(lock);
+    splx(spl);
+    return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
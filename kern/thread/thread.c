@@ -17,6 +17,8 @@
 
 //our includes
 #include <synch.h>
+#include <timer.h>
+#include <pid.h>
 
 /* States a thread can be in. */
 typedef enum {
@@ -29,12 +31,40 @@ typedef enum {
 /* Global variable for the thread currently executing at any given time. */
 struct thread *curthread;
 
-/* Table of sleeping threads. */
-static struct array *sleepers;
+/*
+ * Sleeping threads, hashed by sleep address. Each bucket is a FIFO
+ * list linked through t_sleepnext, so threads sleeping on the same
+ * address are woken in the order they went to sleep. Waking one
+ * thread only looks at its bucket, not at every sleeping thread.
+ */
+#define SLEEP_BUCKETS 64
+
+struct sleepbucket {
+	struct thread *head;
+	struct thread *tail;
+};
+
+static struct sleepbucket sleepers[SLEEP_BUCKETS];
 
 /* List of dead threads to be disposed of. */
 static struct array *zombies;
 
+/* Where thread structures come from. */
+static struct kcache *thread_cache;
+
+/*
+ * Thread shells: structures of destroyed threads, kept together with
+ * their stack (magic number already in place) so thread_fork can reuse
+ * them without going to the allocator. At most thread_shellmax are
+ * kept; they are linked through t_sleepnext.
+ */
+#define THREAD_SHELLS 16
+
+static struct thread *shells;
+static int nshells;
+static int thread_shellmax = THREAD_SHELLS;
+static unsigned long shell_hits, shell_misses;
+
 /* Total number of outstanding threads. Does not count zombies[]. */
 static int numthreads;
 
@@ -44,22 +74,111 @@ static int numthreads;
  */
 
 
+/*
+ * Take a thread shell, if there is one. Its t_stack is set.
+ */
+static struct thread *
+shell_get(void)
+{
+	struct thread *thread;
+	int spl = splhigh();
+
+	thread = shells;
+	if (thread != NULL)
+	{
+		shells = thread->t_sleepnext;
+		nshells--;
+		shell_hits++;
+	}
+	else
+	{
+		shell_misses++;
+	}
+	splx(spl);
+	return thread;
+}
+
+/*
+ * Give back the memory of a thread that is not running: keep it as a
+ * shell if it has a stack and there is room, otherwise free it.
+ */
+static void
+thread_release(struct thread *thread)
+{
+	int spl;
+
+	if (thread->t_name != NULL)
+	{
+		kfree(thread->t_name);
+		thread->t_name = NULL;
+	}
+
+	spl = splhigh();
+	if (thread->t_stack != NULL && nshells < thread_shellmax)
+	{
+		thread->t_sleepnext = shells;
+		shells = thread;
+		nshells++;
+		splx(spl);
+		return;
+	}
+	splx(spl);
+
+	if (thread->t_stack != NULL)
+	{
+		kfree(thread->t_stack);
+	}
+	kcache_free(thread_cache, thread);
+}
+
+/*
+ * Free shells until at most KEEP are left. Returns how many stacks
+ * were freed.
+ */
+static int
+shell_trim(int keep)
+{
+	struct thread *thread;
+	int freed = 0;
+	int spl = splhigh();
+
+	while (nshells > keep)
+	{
+		thread = shells;
+		shells = thread->t_sleepnext;
+		nshells--;
+		kfree(thread->t_stack);
+		kcache_free(thread_cache, thread);
+		freed++;
+	}
+	splx(spl);
+	return freed;
+}
+
 static struct thread *
 thread_create(const char *name)
 {
-	struct thread *thread = kmalloc(sizeof(struct thread));
+	struct thread *thread = shell_get();
 	if (thread == NULL)
 	{
-		return NULL;
+		thread = kcache_alloc(thread_cache);
+		if (thread == NULL)
+		{
+			return NULL;
+		}
+		thread->t_stack = NULL;
 	}
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL)
 	{
-		kfree(thread);
+		thread_release(thread);
 		return NULL;
 	}
 	thread->t_sleepaddr = NULL;
-	thread->t_stack = NULL;
+	thread->t_sleepnext = NULL;
+	thread->t_timedout = 0;
+	thread->t_priority = 0;
+	thread->t_ticks = 0;
 
 	thread->t_vmspace = NULL;
 
@@ -70,23 +189,12 @@ thread_create(const char *name)
 	// If you add things to the thread structure, be sure to initialize
 	// them here.
 
-	//This must be atomic so that the currentpidcount cannot be interfered with and locks cant be STOLEN
-	int spl = splhigh();
-	//Say that the process is used
-	processtable[currentpidcount].pidUsed = 2;
-	//Acquire and create the lock to say that you are running
-	processtable[currentpidcount].exitlock = lock_create("exitlock");
-	lock_acquire(processtable[currentpidcount].exitlock);
-	//Set the PID to the next on the queue
-	processtable[currentpidcount].pid = currentpidcount;
-	//Same thing
-	thread->pid = currentpidcount;
-	//Make this thread the thread in the ptable
-	processtable[currentpidcount].thread = thread;
-	//Move to the next PID
-	currentpidcount++;
-
-	splx(spl);
+	//Get a PID (and a process table entry), as a child of the current thread
+	if (pid_alloc(thread))
+	{
+		thread_release(thread);
+		return NULL;
+	}
 
 	return thread;
 }
@@ -113,14 +221,7 @@ thread_destroy(struct thread *thread)
 	assert(thread->t_vmspace == NULL);
 	assert(thread->t_cwd == NULL);
 
-	if (thread->t_stack)
-	{
-		kfree(thread->t_stack);
-	}
-
-	kfree(thread->t_name);
-	//kfree(thread->childpids);
-	kfree(thread);
+	thread_release(thread);
 	splx(spl);
 
 }
@@ -154,7 +255,8 @@ exorcise(void)
 static void
 thread_killall(void)
 {
-	int i, result;
+	int i;
+	struct thread *t;
 
 	assert(curspl > 0);
 
@@ -163,24 +265,23 @@ thread_killall(void)
 	 * wake up while we're shutting down.
 	 */
 
-	for (i = 0; i < array_getnum(sleepers); i++)
+	for (i = 0; i < SLEEP_BUCKETS; i++)
 	{
-		struct thread *t = array_getguy(sleepers, i);
-		kprintf("sleep: Dropping thread %s\n", t->t_name);
+		for (t = sleepers[i].head; t != NULL; t = t->t_sleepnext)
+		{
+			kprintf("sleep: Dropping thread %s\n", t->t_name);
 
-		/*
-		 * Don't do this: because these threads haven't
-		 * been through thread_exit, thread_destroy will
-		 * get upset. Just drop the threads on the floor,
-		 * which is safer anyway during panic.
-		 *
-		 * array_add(zombies, t);
-		 */
+			/*
+			 * Don't do this: because these threads haven't
+			 * been through thread_exit, thread_destroy will
+			 * get upset. Just drop the threads on the floor,
+			 * which is safer anyway during panic.
+			 *
+			 * array_add(zombies, t);
+			 */
+		}
+		sleepers[i].head = sleepers[i].tail = NULL;
 	}
-
-	result = array_setsize(sleepers, 0);
-	/* shrinking array: not supposed to fail */
-	assert(result == 0);
 }
 
 /*
@@ -203,10 +304,12 @@ thread_bootstrap(void)
 	struct thread *me;
 
 	/* Create the data structures we need. */
-	sleepers = array_create();
-	if (sleepers == NULL)
+	pid_bootstrap();
+
+	thread_cache = kcache_create("thread", sizeof(struct thread), NULL);
+	if (thread_cache == NULL)
 	{
-		panic("Cannot create sleepers array\n");
+		panic("Cannot create thread cache\n");
 	}
 
 	zombies = array_create();
@@ -248,8 +351,6 @@ thread_bootstrap(void)
  */
 void thread_shutdown(void)
 {
-	array_destroy(sleepers);
-	sleepers = NULL;
 	array_destroy(zombies);
 	zombies = NULL;
 	// Don't do this - it frees our stack and we blow up
@@ -276,20 +377,31 @@ int thread_fork(const char *name,
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newguy->t_stack = kmalloc(STACK_SIZE);
+	/* Allocate a stack, unless the thread came from a shell */
 	if (newguy->t_stack == NULL)
 	{
-		kfree(newguy->t_name);
-		kfree(newguy);
-		return ENOMEM;
-	}
+		newguy->t_stack = kmalloc(STACK_SIZE);
+		if (newguy->t_stack == NULL)
+		{
+			pid_release(newguy->pid);
+			thread_release(newguy);
+			return ENOMEM;
+		}
 
-	/* stick a magic number on the bottom end of the stack */
-	newguy->t_stack[0] = 0xae;
-	newguy->t_stack[1] = 0x11;
-	newguy->t_stack[2] = 0xda;
-	newguy->t_stack[3] = 0x33;
+		/* stick a magic number on the bottom end of the stack */
+		newguy->t_stack[0] = 0xae;
+		newguy->t_stack[1] = 0x11;
+		newguy->t_stack[2] = 0xda;
+		newguy->t_stack[3] = 0x33;
+	}
+	else
+	{
+		/* A reused stack was checked when its last thread exited */
+		assert(newguy->t_stack[0] == (char)0xae);
+		assert(newguy->t_stack[1] == (char)0x11);
+		assert(newguy->t_stack[2] == (char)0xda);
+		assert(newguy->t_stack[3] == (char)0x33);
+	}
 
 	/* Inherit the current directory */
 	if (curthread->t_cwd != NULL)
@@ -306,13 +418,9 @@ int thread_fork(const char *name,
 
 	/*
 	 * Make sure our data structures have enough space, so we won't
-	 * run out later at an inconvenient time.
+	 * run out later at an inconvenient time. (Sleeping needs no
+	 * space; threads are linked into sleepers[] directly.)
 	 */
-	result = array_preallocate(sleepers, numthreads + 1);
-	if (result)
-	{
-		goto fail;
-	}
 	result = array_preallocate(zombies, numthreads + 1);
 	if (result)
 	{
@@ -363,13 +471,133 @@ fail:
 	{
 		VOP_DECREF(newguy->t_cwd);
 	}
-	kfree(newguy->t_stack);
-	kfree(newguy->t_name);
-	kfree(newguy);
+	pid_release(newguy->pid);
+	thread_release(newguy);
 
 	return result;
 }
 
+/*
+ * Set how many thread shells to keep, freeing any over the new limit.
+ * Returns the old limit.
+ */
+int
+thread_setshells(int max)
+{
+	int old = thread_shellmax;
+
+	thread_shellmax = max;
+	shell_trim(max);
+	return old;
+}
+
+/*
+ * Free all thread shells; for when memory is short.
+ */
+int
+thread_shrink(void)
+{
+	return shell_trim(0);
+}
+
+void
+thread_printstats(void)
+{
+	kprintf("Thread shells: %d cached (max %d), %lu threads reused one, "
+		"%lu did not\n", nshells, thread_shellmax, shell_hits,
+		shell_misses);
+}
+
+/*
+ * The sleepers[] bucket for sleep address ADDR. Sleep addresses are
+ * mostly kernel heap objects, so the low bits carry little.
+ */
+static struct sleepbucket *
+sleep_bucket(const void *addr)
+{
+	u_int32_t a = (u_int32_t)addr;
+
+	return &sleepers[((a >> 4) ^ (a >> 10)) % SLEEP_BUCKETS];
+}
+
+/*
+ * Put T, which is going to sleep on T->t_sleepaddr, at the end of its
+ * bucket. Interrupts must be off.
+ */
+static void
+sleep_enqueue(struct thread *t)
+{
+	struct sleepbucket *b = sleep_bucket(t->t_sleepaddr);
+
+	t->t_sleepnext = NULL;
+	if (b->tail != NULL)
+	{
+		b->tail->t_sleepnext = t;
+	}
+	else
+	{
+		b->head = t;
+	}
+	b->tail = t;
+}
+
+/*
+ * Take sleeping threads off ADDR's bucket and make them runnable: the
+ * first one if ONE is set, otherwise all of them. If WHICH is not NULL
+ * only that thread is a candidate. Returns how many were woken.
+ * Interrupts must be off.
+ */
+static int
+sleep_wake(const void *addr, struct thread *which, int one)
+{
+	struct sleepbucket *b = sleep_bucket(addr);
+	struct thread *t, *prev, *next;
+	int result, woken = 0;
+
+	assert(curspl > 0);
+
+	prev = NULL;
+	for (t = b->head; t != NULL; t = next)
+	{
+		next = t->t_sleepnext;
+		if (t->t_sleepaddr != addr || (which != NULL && t != which))
+		{
+			prev = t;
+			continue;
+		}
+
+		// Remove from the bucket
+		if (prev != NULL)
+		{
+			prev->t_sleepnext = next;
+		}
+		else
+		{
+			b->head = next;
+		}
+		if (b->tail == t)
+		{
+			b->tail = prev;
+		}
+		t->t_sleepnext = NULL;
+
+		/*
+		 * Because we preallocate during thread_fork,
+		 * this should never fail.
+		 */
+		scheduler_wakeup(t);
+		result = make_runnable(t);
+		assert(result == 0);
+		woken++;
+
+		if (one)
+		{
+			break;
+		}
+	}
+	return woken;
+}
+
 /*
  * High level, machine-independent context switch code.
  */
@@ -420,11 +648,9 @@ mi_switch(threadstate_t nextstate)
 	}
 	else if (nextstate == S_SLEEP)
 	{
-		/*
-		 * Because we preallocate sleepers[] during thread_fork,
-		 * this should never fail.
-		 */
-		result = array_add(sleepers, cur);
+		/* Linking into sleepers[] cannot fail. */
+		sleep_enqueue(cur);
+		result = 0;
 	}
 	else
 	{
@@ -488,6 +714,12 @@ void thread_exit(void)
 		assert(curthread->t_stack[3] == (char)0x33);
 	}
 
+	/*
+	 * Give up our PID. If our parent is still around it keeps our
+	 * exit status for waitpid; see pid.h.
+	 */
+	pid_exit(curthread->pid);
+
 	splhigh();
 
 	if (curthread->t_vmspace)
@@ -521,8 +753,8 @@ void thread_yield(void)
 {
 	int spl = splhigh();
 
-	/* Check sleepers just in case we get here after shutdown */
-	assert(sleepers != NULL);
+	/* Check zombies just in case we get here after shutdown */
+	assert(zombies != NULL);
 
 	mi_switch(S_READY);
 	splx(spl);
@@ -550,71 +782,65 @@ void thread_sleep(const void *addr)
 }
 
 /*
- * Wake up one or more threads who are sleeping on "sleep address"
- * ADDR.
+ * Timer function for thread_sleep_until: wake the thread if it is
+ * still asleep (it may already have been woken and not run yet).
  */
-void thread_wakeup(const void *addr)
+static void
+sleep_timeout(void *data)
 {
-	int i, result;
-
-	// meant to be called with interrupts off
-	assert(curspl > 0);
-
-	// This is inefficient. Feel free to improve it.
+	struct thread *t = data;
 
-	for (i = 0; i < array_getnum(sleepers); i++)
+	if (t->t_sleepaddr != NULL && sleep_wake(t->t_sleepaddr, t, 1))
 	{
-		struct thread *t = array_getguy(sleepers, i);
-		if (t->t_sleepaddr == addr)
-		{
-
-			// Remove from list
-			array_remove(sleepers, i);
-
-			// must look at the same sleepers[i] again
-			i--;
-
-			/*
-			 * Because we preallocate during thread_fork,
-			 * this should never fail.
-			 */
-			result = make_runnable(t);
-			assert(result == 0);
-		}
+		t->t_timedout = 1;
 	}
 }
 
-//Wakeup but for only one thread
-void thread_wakeone(const void *addr)
+/*
+ * Like thread_sleep, but give up at tick DEADLINE (see timer.h).
+ * Returns ETIMEDOUT if woken by the deadline rather than a
+ * thread_wakeup, including when DEADLINE has already passed.
+ */
+int thread_sleep_until(const void *addr, u_int32_t deadline)
 {
-	int i, result;
-	int done = 0;
+	struct timer timeout;
 
-	// meant to be called with interrupts off
+	assert(in_interrupt == 0);
 	assert(curspl > 0);
 
-	for (i = 0; i < array_getnum(sleepers) && !done; i++)
+	if ((int32_t)(deadline - timer_now()) <= 0)
 	{
-		struct thread *t = array_getguy(sleepers, i);
-		if (t->t_sleepaddr == addr)
-		{
+		return ETIMEDOUT;
+	}
 
-			// Remove from list
-			array_remove(sleepers, i);
+	timer_init(&timeout, sleep_timeout, curthread);
+	timer_set(&timeout, deadline);
+	curthread->t_timedout = 0;
+	thread_sleep(addr);
+	timer_cancel(&timeout);
 
-			// must look at the same sleepers[i] again
-			i--;
+	return curthread->t_timedout ? ETIMEDOUT : 0;
+}
 
-			/*
-             * Because we preallocate during thread_fork,
-             * this should never fail.
-             */
-			result = make_runnable(t);
-			assert(result == 0);
+/*
+ * Wake up one or more threads who are sleeping on "sleep address"
+ * ADDR.
+ */
+void thread_wakeup(const void *addr)
+{
+	// meant to be called with interrupts off
+	assert(curspl > 0);
 
-			done = 1;
-		}
-	}
+	sleep_wake(addr, NULL, 0);
+}
+
+//Wakeup but for only one thread (the one that has slept longest on ADDR)
+void thread_wakeone(const void *addr)
+{
+	// meant to be called with interrupts off
+	assert(curspl > 0);
+
+	sleep_wake(addr, NULL, 1);
 }
 
 /*
@@ -623,14 +849,13 @@ void thread_wakeone(const void *addr)
  */
 int thread_hassleepers(const void *addr)
 {
-	int i;
+	struct thread *t;
 
 	// meant to be called with interrupts off
 	assert(curspl > 0);
 
-	for (i = 0; i < array_getnum(sleepers); i++)
+	for (t = sleep_bucket(addr)->head; t != NULL; t = t->t_sleepnext)
 	{
-		struct thread *t = array_getguy(sleepers, i);
 		if (t->t_sleepaddr == addr)
 		{
 			return 1;
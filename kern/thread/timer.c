@@ -0,0 +1,277 @@
+/*
+ * Kernel timers. See timer.h.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <machine/spl.h>
+#include <thread.h>
+#include <clock.h>
+#include <timer.h>
+
+#define WHEEL_LEVELS  3
+#define WHEEL_BITS    6
+#define WHEEL_SLOTS   (1 << WHEEL_BITS)
+#define WHEEL_MASK    (WHEEL_SLOTS - 1)
+
+/* Furthest ahead a timer can be placed directly; later ones wait in
+   the last slot that far out and are placed again when it comes up. */
+#define WHEEL_RANGE   ((1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1)
+
+static struct timer *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/* Ticks the wheel has processed, and ticks gone by not processed yet. */
+static u_int32_t wheel_ticks;
+static u_int32_t owed_ticks;
+
+static int timers_pending;
+static unsigned long timers_fired;
+
+void
+timer_init(struct timer *t, void (*func)(void *), void *data)
+{
+	t->tm_next = NULL;
+	t->tm_prevp = NULL;
+	t->tm_expires = 0;
+	t->tm_func = func;
+	t->tm_data = data;
+}
+
+static
+void
+slot_push(struct timer **slot, struct timer *t)
+{
+	t->tm_next = *slot;
+	if (t->tm_next != NULL) {
+		t->tm_next->tm_prevp = &t->tm_next;
+	}
+	t->tm_prevp = slot;
+	*slot = t;
+}
+
+/*
+ * Put T in the slot for its expiry time, relative to the ticks the
+ * wheel has processed.
+ */
+static
+void
+wheel_insert(struct timer *t)
+{
+	u_int32_t delta, when;
+	struct timer **slot;
+
+	when = t->tm_expires;
+	delta = when - wheel_ticks;
+	if ((int32_t)delta <= 0) {
+		/* Already due: the next tick processed. */
+		when = wheel_ticks + 1;
+		delta = 1;
+	}
+	else if (delta > WHEEL_RANGE) {
+		when = wheel_ticks + WHEEL_RANGE;
+		delta = WHEEL_RANGE;
+	}
+
+	if (delta < (1 << WHEEL_BITS)) {
+		slot = &wheel[0][when & WHEEL_MASK];
+	}
+	else if (delta < (1 << (2 * WHEEL_BITS))) {
+		slot = &wheel[1][(when >> WHEEL_BITS) & WHEEL_MASK];
+	}
+	else {
+		slot = &wheel[2][(when >> (2 * WHEEL_BITS)) & WHEEL_MASK];
+	}
+
+	slot_push(slot, t);
+}
+
+static
+void
+wheel_remove(struct timer *t)
+{
+	*t->tm_prevp = t->tm_next;
+	if (t->tm_next != NULL) {
+		t->tm_next->tm_prevp = t->tm_prevp;
+	}
+	t->tm_next = NULL;
+	t->tm_prevp = NULL;
+}
+
+void
+timer_set(struct timer *t, u_int32_t expires)
+{
+	assert(curspl>0);
+	assert(t->tm_prevp == NULL);
+
+	t->tm_expires = expires;
+	wheel_insert(t);
+	timers_pending++;
+
+	/* If the tick is stopped, the one-shot may need to come sooner. */
+	clock_rearm();
+}
+
+int
+timer_cancel(struct timer *t)
+{
+	assert(curspl>0);
+
+	if (t->tm_prevp == NULL) {
+		return 0;
+	}
+	wheel_remove(t);
+	timers_pending--;
+	return 1;
+}
+
+u_int32_t
+timer_now(void)
+{
+	int spl;
+	u_int32_t now;
+
+	spl = splhigh();
+	clock_sync();
+	now = wheel_ticks + owed_ticks;
+	splx(spl);
+	return now;
+}
+
+u_int32_t
+timer_ms2ticks(u_int32_t msecs)
+{
+	return (msecs / 1000) * HZ + ((msecs % 1000) * HZ + 999) / 1000;
+}
+
+u_int32_t
+timer_deadline(u_int32_t msecs)
+{
+	if (msecs == 0) {
+		return timer_now();
+	}
+	return timer_now() + timer_ms2ticks(msecs) + 1;
+}
+
+void
+timer_advance(u_int32_t ticks)
+{
+	owed_ticks += ticks;
+}
+
+/*
+ * Move the timers in a slot of an upper level down to where they go
+ * now that their time is closer. This happens in timer_run before it
+ * looks at level 0 for the tick, so timers due on this very tick go
+ * in its level 0 slot rather than being pushed to the next one.
+ */
+static
+void
+wheel_cascade(int level, int index)
+{
+	struct timer *t, *next;
+
+	t = wheel[level][index];
+	wheel[level][index] = NULL;
+	for (; t != NULL; t = next) {
+		next = t->tm_next;
+		if (t->tm_expires == wheel_ticks) {
+			slot_push(&wheel[0][wheel_ticks & WHEEL_MASK], t);
+		}
+		else {
+			wheel_insert(t);
+		}
+	}
+}
+
+void
+timer_run(void)
+{
+	struct timer *t;
+	int index;
+
+	assert(curspl>0);
+
+	while (owed_ticks > 0) {
+		owed_ticks--;
+		wheel_ticks++;
+
+		index = wheel_ticks & WHEEL_MASK;
+		if (index == 0) {
+			/* Top level first, so what it drops into level 1 cascades too. */
+			if (((wheel_ticks >> WHEEL_BITS) & WHEEL_MASK) == 0) {
+				wheel_cascade(2, (wheel_ticks >> (2*WHEEL_BITS))
+					      & WHEEL_MASK);
+			}
+			wheel_cascade(1, (wheel_ticks >> WHEEL_BITS) & WHEEL_MASK);
+		}
+
+		/*
+		 * Take them off one at a time: a timer function may set
+		 * or cancel other timers, including ones in this slot.
+		 */
+		while ((t = wheel[0][index]) != NULL) {
+			wheel_remove(t);
+			timers_pending--;
+			timers_fired++;
+			t->tm_func(t->tm_data);
+		}
+	}
+}
+
+u_int32_t
+timer_next(void)
+{
+	u_int32_t i, limit;
+
+	if (timers_pending == 0) {
+		return 0;
+	}
+
+	/*
+	 * Look no further than the next cascade, which can bring down
+	 * timers due before anything later in the first level. If
+	 * nothing is due by then, I ends up at the cascade. Ticks gone
+	 * by but not yet processed count against it.
+	 */
+	limit = WHEEL_SLOTS - (wheel_ticks & WHEEL_MASK);
+	for (i = 1; i < limit; i++) {
+		if (wheel[0][(wheel_ticks + i) & WHEEL_MASK] != NULL) {
+			break;
+		}
+	}
+	return i > owed_ticks ? i - owed_ticks : 1;
+}
+
+/*
+ * Timer function for timer_sleep: the address slept on is the timer.
+ */
+static
+void
+timer_wakeup(void *data)
+{
+	thread_wakeup(data);
+}
+
+void
+timer_sleep(u_int32_t ticks)
+{
+	struct timer t;
+	int spl;
+
+	timer_init(&t, timer_wakeup, &t);
+
+	spl = splhigh();
+	/* Plus one for the part of this tick already gone. */
+	timer_set(&t, timer_now() + ticks + 1);
+	while (t.tm_prevp != NULL) {
+		thread_sleep(&t);
+	}
+	splx(spl);
+}
+
+void
+timer_printstats(void)
+{
+	kprintf("Timers: %d pending, %lu gone off, now at tick %lu\n",
+		timers_pending, timers_fired, (unsigned long) timer_now());
+}
@@ -94,6 +94,8 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	Elf_Phdr ph;   /* "Program header" = segment header */
 	int result, i;
 	struct uio ku;
+	Region *region;  /* region a segment was defined as */
+	size_t delta;
 
 	/*
 	 * Read the executable header from offset 0 in the file.
@@ -222,17 +224,27 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		}
 
 
-		if(i == 1) {
-			curthread->t_vmspace->v = v;
-			((curthread->t_vmspace)->region1).offset = ph.p_offset;
-			((curthread->t_vmspace)->region1).filesize = ph.p_filesz;
-			((curthread->t_vmspace)->region1).is_executable = ph.p_flags & PF_X;
+		//Pages are read from the file on demand, so every segment keeps its own reference.
+		//The region starts on a page boundary, so back the offset up by as much as the
+		//segment's start was rounded down (the file and memory layouts agree mod PAGE_SIZE).
+		region = as_findregion(curthread->t_vmspace, ph.p_vaddr);
+		if (region == NULL) {
+			/* empty segment, nothing to load */
+			continue;
 		}
-		if(i == 2) {
-			((curthread->t_vmspace)->region2).offset = ph.p_offset;
-			((curthread->t_vmspace)->region2).filesize = ph.p_filesz;
-			((curthread->t_vmspace)->region2).is_executable = ph.p_flags & PF_X;
+		delta = ph.p_vaddr - region->vbase;
+		if ((size_t)ph.p_offset < delta) {
+			kprintf("ELF: segment at 0x%lx is not page-aligned in the file\n",
+				(unsigned long)ph.p_vaddr);
+			return ENOEXEC;
 		}
+		VOP_INCREF(v);
+		region->v = v;
+		region->offset = ph.p_offset - delta;
+		region->filesize = ph.p_filesz + delta;
+		region->is_executable = ph.p_flags & PF_X;
+		/* text is shared between processes through the page cache */
+		region->cached = (ph.p_flags & PF_X) != 0;
 		// result = load_segment(v, ph.p_offset, ph.p_vaddr, 
 		// 		      ph.p_memsz, ph.p_filesz,
 		// 		      ph.p_flags & PF_X);
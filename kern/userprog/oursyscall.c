@@ -1,7 +1,14 @@
 #include <oursyscall.h>
 #include <ourextern.h>
 #include <kern/limits.h>
+#include <kern/mman.h>
+#include <kern/stat.h>
+#include <kern/time.h>
+#include <vnode.h>
 #include <addrspace.h>
+#include <swap.h>
+#include <timer.h>
+#include <pid.h>
 
 //Handle write using copyin to copy from buffer to temp (checks validity of user buf ptr) and print if successful (else return with error)
 int sys_write(void* buf, size_t nbytes) {
@@ -40,11 +47,19 @@ int sys_read(void* buf, size_t nbytes) {
     return (failure ? failure : 0);
 };
 
+struct kcache* trapframe_cache = NULL;
+
+void oursyscall_bootstrap(void) {
+    trapframe_cache = kcache_create("trapframe", sizeof(Trapframe), NULL);
+    if (trapframe_cache == NULL) {
+        panic("oursyscall_bootstrap: cannot create trapframe cache\n");
+    }
+}
+
 int sys_fork(trapframeptr currentTF, int*retval) { 
     //Create child TF and copy current TF
-    trapframeptr childTF = kmalloc(sizeof(Trapframe));
+    trapframeptr childTF = kcache_alloc(trapframe_cache);
     if (childTF == NULL) {
-        kfree(childTF);
         return ENOMEM;
     }
     memcpy(childTF,currentTF,sizeof(Trapframe));
@@ -52,7 +67,7 @@ int sys_fork(trapframeptr currentTF, int*retval) {
     //Copy child AS from parent (Need as_copy(curAS, AS** newAS) from addrspace.h)
     addrspaceptr childAS = NULL; 
     if (as_copy(curthread->t_vmspace,&childAS)) {
-        kfree(childTF);
+        kcache_free(trapframe_cache, childTF);
         return ENOMEM; //as_copy will only error with ENOMEM else returns 0
     }
 
@@ -66,8 +81,8 @@ int sys_fork(trapframeptr currentTF, int*retval) {
 
     //Only parent gets here (childThread goes to md_forkentry). If no errors, set retval to child's PID and return 0 for no error
     if (forkerror) {
-        //kfree?
-        //kfree(childTF);
+        kcache_free(trapframe_cache, childTF);
+        as_destroy(childAS);
         return forkerror;
     }
     *retval = childThread->pid;
@@ -288,17 +303,15 @@ int sys_getpid(void) {
 };
 
 int sys_waitpid(pid_t pid, int *status, int options, int* retval) {
-    if (pid > 99) {
-        return EINVAL;
-    }
+    int exitcode, err;
 
     //Check status arg (badbeef, deadbeef, NULL, alignment)
     if (status == NULL || status == (int*)0xbadbeef || status == (int*)0xdeadbeef || ((intptr_t)status%4)) {
         return EFAULT;
     }
 
-    //Check options is 0 or special number for menu and if pid is in range and in use
-    if((options != 0 && options != 6969) || processtable[pid].pid<=0 || processtable[pid].pidUsed == 0)
+    //Check options is 0 or special number for menu (pid_wait checks the pid)
+    if(options != 0 && options != 6969)
         return EINVAL;
 
     //If not called from the kernel (i.e. from menu) using a special option code, check mem is from user space
@@ -309,26 +322,21 @@ int sys_waitpid(pid_t pid, int *status, int options, int* retval) {
         if (result) return EFAULT;
     }
     
-    //Check if someone is already waiting, if so EINVAL else set flag to show waiting
-    if (processtable[pid].waited == 1)
-        return EINVAL;
-    else processtable[pid].waited = 1;
-
-    //Grab lock (process will sleep here if lock not already released and naturally wait for child exit)
-    lock_acquire(processtable[pid].exitlock);
+    //Sleep until the child exits, collect its exit code and free its PID (it must be our child,
+    //not already waited for)
+    err = pid_wait(pid, &exitcode);
+    if (err) {
+        return err;
+    }
     *retval = pid;
-    *status = processtable[pid].exit_code;
-    lock_release(processtable[pid].exitlock);
+    *status = exitcode;
 
     return 0;
 };
 
-//Exit by setting exit code, changing pidUsed, giving up the lock (giving it to those waiting to acquire it), and calling thread_exit
+//Exit by recording the exit code and calling thread_exit, which hands it to whoever waits for us
 int sys__exit(int exitcode) {
-    processtable[curthread->pid].exit_code = exitcode;
-    processtable[curthread->pid].pidUsed = 1;
-    lock_release(processtable[curthread->pid].exitlock);
-    //lock_destroy(processtable[curthread->pid].exitlock);
+    pid_setexitcode(curthread->pid, exitcode);
     thread_exit();
     return 0;
 };
@@ -384,50 +392,13 @@ int sys_sbrk(intptr_t amount, int* retval) {
             return EINVAL;
         }
 
-        //Give back any necessary pages
-	    int spl;
-	    spl = splhigh();
-
         //Adjust heap end
+        vaddr_t oldend = ((curthread->t_vmspace)->heap).vend;
         ((curthread->t_vmspace)->heap).vend += amount;
 
-        PageTableEntry* current = ((curthread->t_vmspace)->heap).localPageTable;
-        if (current == NULL) {
-            splx(spl);
-            return 0;
-        }
-        
-        //Check if the first entry needs to be freed
-        if ((current != NULL) && (current->vaddr >= ((curthread->t_vmspace)->heap).vend)) {
-            ((curthread->t_vmspace)->heap).localPageTable = NULL;
-            int cmIndex = (current->paddr - firstpaddr)/PAGE_SIZE;
-		    ourcoremap[cmIndex].state--; //state-- rather than CM_FREE
-            kfree(current);
-            splx(spl);
-            ((curthread->t_vmspace)->heap).numPages--;
-            return 0;
-        }
-
-        //Otherwise, start scan until the end
-        PageTableEntry* prev = current;
-        current = current->next;
-        while (current != NULL) {
-            if (current->vaddr >= ((curthread->t_vmspace)->heap).vend) {
-                //Rethread
-                prev->next = current->next;
-                //Free page and reset current
-                int cmIndex = (current->paddr - firstpaddr)/PAGE_SIZE;
-		        ourcoremap[cmIndex].state--; //state-- rather than CM_FREE
-                kfree(current);
-                current = prev->next;
-                ((curthread->t_vmspace)->heap).numPages--;
-            }
-            else {
-                prev = current;
-                current = current -> next;
-            }
-        }
-        splx(spl);
+        //Free every page that now starts at or past the new end of the heap
+        as_discard(curthread->t_vmspace, &((curthread->t_vmspace)->heap),
+            (((curthread->t_vmspace)->heap).vend + PAGE_SIZE - 1) & PAGE_FRAME, oldend);
         return 0;
     }
     else {
@@ -443,3 +414,186 @@ int sys_sbrk(intptr_t amount, int* retval) {
 
     return 0;
 }
+
+int sys_mmap(const char* path, size_t length, int prot, int flags, userptr_t offsetptr, int* retval) {
+    struct addrspace* as = curthread->t_vmspace;
+    char* kpath;
+    struct vnode* v;
+    struct stat st;
+    off_t offset;
+    size_t filesize;
+    vaddr_t addr;
+    int perms, shared, result;
+
+    //The offset is the fifth argument, so it is on the user stack after the four argument slots
+    result = copyin(offsetptr, &offset, sizeof(off_t));
+    if (result) {
+        return result;
+    }
+
+    //Exactly one of MAP_SHARED and MAP_PRIVATE, and whole pages of the file
+    if (length == 0 || offset < 0 || offset % PAGE_SIZE ||
+        (flags != MAP_SHARED && flags != MAP_PRIVATE)) {
+        return EINVAL;
+    }
+    shared = (flags == MAP_SHARED);
+    perms = ((prot & PROT_READ) ? REGION_READ : 0) | ((prot & PROT_WRITE) ? REGION_WRITE : 0) |
+            ((prot & PROT_EXEC) ? REGION_EXEC : 0);
+
+    kpath = kmalloc(PATH_MAX);
+    if (kpath == NULL) {
+        return ENOMEM;
+    }
+    result = copyinstr(path, kpath, PATH_MAX, NULL);
+    if (result) {
+        kfree(kpath);
+        return result;
+    }
+
+    //Writing a shared mapping writes the file
+    result = vfs_open(kpath, (shared && (prot & PROT_WRITE)) ? O_RDWR : O_RDONLY, &v);
+    kfree(kpath);
+    if (result) {
+        return result;
+    }
+
+    //Ask the filesystem whether it can be mapped, and how much of it is there to map
+    result = VOP_MMAP(v);
+    if (!result) result = VOP_STAT(v, &st);
+    if (result) {
+        vfs_close(v);
+        return result;
+    }
+    filesize = (st.st_size > offset) ? (size_t)(st.st_size - offset) : 0;
+    if (filesize > length) {
+        filesize = length;
+    }
+
+    //The region keeps its own reference to the file
+    result = as_define_mapping(as, v, offset, filesize, length, perms, shared, &addr);
+    vfs_close(v);
+    if (result) {
+        return result;
+    }
+
+    *retval = addr;
+    return 0;
+}
+
+int sys_munmap(vaddr_t addr, size_t length) {
+    struct addrspace* as = curthread->t_vmspace;
+    Region* region;
+
+    //Only whole mappings can be removed
+    region = as_findregion(as, addr);
+    if (region == NULL || region->vbase != addr || region->v == NULL ||
+        region->vend != ((addr + length + PAGE_SIZE - 1) & PAGE_FRAME)) {
+        return EINVAL;
+    }
+    return as_removeregion(as, region);
+}
+
+int sys_madvise(vaddr_t addr, size_t length, int advice) {
+    struct addrspace* as = curthread->t_vmspace;
+    vaddr_t end, chunkend;
+    Region* region;
+    int result;
+
+    if ((addr & ~(vaddr_t)PAGE_FRAME) != 0 || addr + length < addr) {
+        return EINVAL;
+    }
+    if (advice < MADV_NORMAL || advice > MADV_DONTNEED) {
+        return EINVAL;
+    }
+    end = (addr + length + PAGE_SIZE - 1) & PAGE_FRAME;
+
+    //The range may cross several regions (heap, stack, file mappings); each piece is handled on its own
+    while (addr < end) {
+        region = as_regionof(as, addr);
+        if (region == NULL) {
+            return ENOMEM;
+        }
+        if (region == &(as->heap)) {
+            chunkend = ((as->heap).vend + PAGE_SIZE - 1) & PAGE_FRAME;
+        }
+        else if (region == &(as->stack)) {
+            chunkend = (as->stack).vend;
+        }
+        else {
+            chunkend = region->vend;
+        }
+        if (chunkend > end) {
+            chunkend = end;
+        }
+
+        switch (advice) {
+            case MADV_NORMAL:
+            case MADV_RANDOM:
+            case MADV_SEQUENTIAL:
+                //Hints about the access pattern apply to the whole region
+                region->advice = advice;
+                region->cluster = (advice == MADV_SEQUENTIAL) ? CLUSTER_MAX : CLUSTER_START;
+                break;
+            case MADV_WILLNEED:
+                result = vm_prefetch(as, region, addr, chunkend);
+                if (result) {
+                    return result;
+                }
+                break;
+            case MADV_DONTNEED:
+                //Changes to a shared mapping have to reach the file before its pages go
+                if (region->shared) {
+                    result = as_syncregion(as, region);
+                    if (result) {
+                        return result;
+                    }
+                }
+                as_discard(as, region, addr, chunkend);
+                break;
+        }
+        addr = chunkend;
+    }
+    return 0;
+}
+
+int sys_getvmstats(int which, struct vmstats* buf) {
+    if (which == VMSTATS_SELF) {
+        return copyout(&(curthread->t_vmspace)->stats, (userptr_t)buf, sizeof(struct vmstats));
+    }
+    if (which == VMSTATS_GLOBAL) {
+        return copyout(&vm_globalstats, (userptr_t)buf, sizeof(struct vmstats));
+    }
+    return EINVAL;
+}
+
+//Sleep for at least the time in REQ, rounded up to whole clock ticks. Nothing can cut a sleep
+//short, so REM (if given) always comes back zero.
+int sys_nanosleep(const struct timespec* req, struct timespec* rem) {
+    struct timespec ts;
+    u_int32_t ticks;
+    int result;
+
+    result = copyin((const_userptr_t)req, &ts, sizeof(ts));
+    if (result) {
+        return result;
+    }
+    if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+        return EINVAL;
+    }
+
+    //Ticks for the seconds (capped so it cannot wrap) plus the nanoseconds rounded up
+    if (ts.tv_sec > 0x7fffffff / HZ - 1) {
+        ts.tv_sec = 0x7fffffff / HZ - 1;
+    }
+    ticks = ts.tv_sec * HZ + (ts.tv_nsec + (1000000000/HZ - 1)) / (1000000000/HZ);
+    if (ticks > 0) {
+        timer_sleep(ticks);
+    }
+
+    if (rem != NULL) {
+        ts.tv_sec = 0;
+        ts.tv_nsec = 0;
+        return copyout(&ts, (userptr_t)rem, sizeof(ts));
+    }
+    return 0;
+}
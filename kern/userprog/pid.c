@@ -0,0 +1,265 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <curthread.h>
+#include <pid.h>
+#include <machine/spl.h>
+
+/*
+ * PID allocation and the process table. See pid.h.
+ */
+
+#define PID_INITIAL 32
+
+static Process* processtable = NULL;
+static int tableSize = 0;
+
+//Free entries, oldest first (-1 when empty)
+static int freeHead = -1;
+static int freeTail = -1;
+static int pidsInUse = 0;
+
+static unsigned long pidAllocs = 0;
+
+static void reap(int pid);
+
+static void freeAppend(int pid) {
+	processtable[pid].nextfree = -1;
+	if (freeTail != -1) {
+		processtable[freeTail].nextfree = pid;
+	}
+	else {
+		freeHead = pid;
+	}
+	freeTail = pid;
+}
+
+//Double the table. Allocation happens with interrupts on, so by the time we have the memory
+//someone else may have grown it already; then ours is just thrown away.
+static int growTable(void) {
+	int oldSize = tableSize;
+	int newSize = oldSize == 0 ? PID_INITIAL : oldSize * 2;
+	Process *newTable, *oldTable;
+	int i, spl;
+
+	if (newSize > PID_MAX) {
+		return EAGAIN;
+	}
+	newTable = kmalloc(newSize * sizeof(Process));
+	if (newTable == NULL) {
+		return ENOMEM;
+	}
+	//The new entries' semaphores live as long as the table does
+	for (i = oldSize; i < newSize; i++) {
+		newTable[i].exitsem = sem_create("exitsem", 0);
+		if (newTable[i].exitsem == NULL) {
+			while (--i >= oldSize) {
+				sem_destroy(newTable[i].exitsem);
+			}
+			kfree(newTable);
+			return ENOMEM;
+		}
+	}
+
+	spl = splhigh();
+	if (tableSize != oldSize) {
+		splx(spl);
+		for (i = oldSize; i < newSize; i++) {
+			sem_destroy(newTable[i].exitsem);
+		}
+		kfree(newTable);
+		return 0;
+	}
+	if (oldSize > 0) {
+		memmove(newTable, processtable, oldSize * sizeof(Process));
+	}
+	oldTable = processtable;
+	processtable = newTable;
+	tableSize = newSize;
+	for (i = oldSize; i < newSize; i++) {
+		processtable[i].pid = i;
+		processtable[i].pidUsed = PROC_FREE;
+		processtable[i].thread = NULL;
+		freeAppend(i);
+	}
+	splx(spl);
+
+	if (oldTable != NULL) {
+		kfree(oldTable);
+	}
+	return 0;
+}
+
+void pid_bootstrap(void) {
+	if (growTable()) {
+		panic("pid: cannot create process table\n");
+	}
+}
+
+//Free the zombie children of PARENT that nobody is waiting for. Interrupts must be off.
+static void reapUnwaited(int parent) {
+	int child, next;
+
+	for (child = processtable[parent].firstchild; child != -1 && processtable[parent].nzombies > 0; child = next) {
+		next = processtable[child].nextsibling;
+		if (processtable[child].pidUsed == PROC_ZOMBIE && !processtable[child].waited) {
+			reap(child);
+		}
+	}
+}
+
+int pid_alloc(struct thread* t) {
+	int pid, parent, result, spl;
+
+	spl = splhigh();
+	//Kernel threads hardly ever wait (only the menu, for the program it just started), so their
+	//exited children are freed here instead of piling up
+	if (curthread != NULL && curthread->t_vmspace == NULL && processtable[curthread->pid].nzombies > 0) {
+		reapUnwaited(curthread->pid);
+	}
+	while (freeHead == -1) {
+		splx(spl);
+		result = growTable();
+		if (result) {
+			return result;
+		}
+		spl = splhigh();
+	}
+
+	pid = freeHead;
+	freeHead = processtable[pid].nextfree;
+	if (freeHead == -1) {
+		freeTail = -1;
+	}
+
+	processtable[pid].pidUsed = PROC_RUNNING;
+	processtable[pid].exit_code = 0;
+	processtable[pid].thread = t;
+	processtable[pid].waited = 0;
+	processtable[pid].firstchild = -1;
+	processtable[pid].nzombies = 0;
+	processtable[pid].prevsibling = -1;
+
+	//Link it under its parent (the first thread has none)
+	parent = curthread != NULL ? curthread->pid : -1;
+	processtable[pid].ppid = parent;
+	processtable[pid].nextsibling = parent == -1 ? -1 : processtable[parent].firstchild;
+	if (parent != -1) {
+		if (processtable[parent].firstchild != -1) {
+			processtable[processtable[parent].firstchild].prevsibling = pid;
+		}
+		processtable[parent].firstchild = pid;
+	}
+
+	t->pid = pid;
+	pidsInUse++;
+	pidAllocs++;
+	splx(spl);
+	return 0;
+}
+
+void pid_setexitcode(pid_t pid, int exitcode) {
+	processtable[pid].exit_code = exitcode;
+}
+
+static void unlinkChild(int pid) {
+	Process* p = &processtable[pid];
+
+	if (p->ppid == -1) {
+		return;
+	}
+	if (p->prevsibling != -1) {
+		processtable[p->prevsibling].nextsibling = p->nextsibling;
+	}
+	else {
+		processtable[p->ppid].firstchild = p->nextsibling;
+	}
+	if (p->nextsibling != -1) {
+		processtable[p->nextsibling].prevsibling = p->prevsibling;
+	}
+	p->ppid = p->nextsibling = p->prevsibling = -1;
+}
+
+//Put PID back on the free list. Interrupts must be off.
+static void reap(int pid) {
+	if (processtable[pid].pidUsed == PROC_ZOMBIE && processtable[pid].ppid != -1) {
+		processtable[processtable[pid].ppid].nzombies--;
+	}
+	unlinkChild(pid);
+	//A zombie nobody waited for leaves its V behind; the next owner must start at 0
+	processtable[pid].exitsem->count = 0;
+	processtable[pid].pidUsed = PROC_FREE;
+	processtable[pid].thread = NULL;
+	freeAppend(pid);
+	pidsInUse--;
+}
+
+void pid_exit(pid_t pid) {
+	int child, next;
+	int spl = splhigh();
+
+	assert(processtable[pid].pidUsed == PROC_RUNNING);
+
+	//Nobody is going to wait for our children now
+	for (child = processtable[pid].firstchild; child != -1; child = next) {
+		next = processtable[child].nextsibling;
+		if (processtable[child].pidUsed == PROC_ZOMBIE) {
+			reap(child);
+		}
+		else {
+			processtable[child].ppid = -1;
+			processtable[child].nextsibling = processtable[child].prevsibling = -1;
+		}
+	}
+	processtable[pid].firstchild = -1;
+	processtable[pid].nzombies = 0;
+	processtable[pid].thread = NULL;
+
+	//Whether or not it ran a program, a live parent may wait (or be waiting) for it
+	if (processtable[pid].ppid != -1) {
+		processtable[pid].pidUsed = PROC_ZOMBIE;
+		processtable[processtable[pid].ppid].nzombies++;
+		V(processtable[pid].exitsem);
+	}
+	else {
+		reap(pid);
+	}
+	splx(spl);
+}
+
+void pid_release(pid_t pid) {
+	int spl = splhigh();
+
+	//It never ran, so nobody can know its PID and it has no children
+	assert(processtable[pid].pidUsed == PROC_RUNNING);
+	assert(processtable[pid].firstchild == -1);
+	reap(pid);
+	splx(spl);
+}
+
+int pid_wait(pid_t pid, int* status) {
+	int spl = splhigh();
+
+	//Only the parent can wait, and only once
+	if (pid <= 0 || pid >= tableSize || processtable[pid].pidUsed == PROC_FREE
+	    || processtable[pid].ppid != curthread->pid || processtable[pid].waited) {
+		splx(spl);
+		return EINVAL;
+	}
+	processtable[pid].waited = 1;
+
+	//The table can be replaced while we sleep, so index it again afterwards
+	P(processtable[pid].exitsem);
+	assert(processtable[pid].pidUsed == PROC_ZOMBIE);
+	*status = processtable[pid].exit_code;
+	reap(pid);
+	splx(spl);
+	return 0;
+}
+
+void pid_printstats(void) {
+	kprintf("Processes: %d PIDs in use of %d, %lu allocated since boot\n",
+		pidsInUse, tableSize, pidAllocs);
+}
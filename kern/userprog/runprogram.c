@@ -55,9 +55,8 @@ runprogram(char *progname, char** args, unsigned long nargs)
 		return result;
 	}
 
-	/* Done with the file now. */
-	//TODO: this properly thread/sys exit
-	//vfs_close(v);
+	/* Done with the file now (the address space holds its own reference). */
+	vfs_close(v);
 
 	/* Define the user stack in the address space */
 	result = as_define_stack(curthread->t_vmspace, &stackptr);
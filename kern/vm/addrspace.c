@@ -3,8 +3,13 @@
 #include <lib.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <swap.h>
+#include <pagecache.h>
+#include <uio.h>
+#include <vnode.h>
 #include <ourextern.h>
 #include <machine/tlb.h>
+#include <machine/spl.h>
 
 /*
  * Note! If OPT_DUMBVM is set, as is the case until you start the VM
@@ -16,97 +21,372 @@ inline vaddr_t maximum (vaddr_t a, vaddr_t b) {
 	return (a>b) ? a : b;
 }
 
-static int createPageTable (Region* region) {
-	assert(region->localPageTable == NULL);
-	assert(((region->vbase) & PAGE_FRAME) == region->vbase);
-	assert(((region->vend) & PAGE_FRAME) == region->vend);
-	
-	if (region->vbase == region->vend) return 0;
-	vaddr_t temp = region->vbase;
-	
-	PageTableEntry* current = kmalloc(sizeof(PageTableEntry));
-	if (current == NULL) return ENOMEM;
-	current->vaddr = temp;
-	current->paddr = getppages(1);
-	if (current->paddr == 0)
-		return ENOMEM;
-	current->next = NULL;
-	region->localPageTable = current;
-	temp+= PAGE_SIZE;
-
-	while (temp < region->vend) {
-		current->next = kmalloc(sizeof(PageTableEntry));
-		current = current->next;
-		if (current == NULL) return ENOMEM;
-		current->vaddr = temp;
-		current->paddr = getppages(1);
-		if (current->paddr == 0)
+//Every address space there is, newest first
+static struct addrspace* allspaces = NULL;
+
+//Release every page mapped in the address space and free the page table itself
+static void destroyPageTable (struct addrspace* as) {
+	int spl;
+	PageTable* pt = as->pagetable;
+	unsigned i, j;
+
+	//An eviction may be writing one of our pages out right now
+	swap_lock();
+	for (i = 0; i < PT_NUMDIRS; i++) {
+		if (pt->tables[i] == NULL) continue;
+		//One second-level table at a time, so interrupts are never off for long
+		spl = splhigh();
+		for (j = 0; j < PT_NUMENTRIES; j++) {
+			if (PTE_PRESENT(pt->tables[i][j])) {
+				releasePage(PTE_PADDR(pt->tables[i][j]));
+				VMSTAT_INC(as, vs_pagefree);
+			}
+			else if (PTE_ISSWAPPED(pt->tables[i][j])) {
+				swap_free(pt->tables[i][j]);
+			}
+		}
+		splx(spl);
+	}
+	swap_unlock();
+	pt_destroy(pt);
+	as->pagetable = NULL;
+	return;
+}
+
+//Set up an empty region covering [vbase, vend)
+static void initRegion(Region* region, vaddr_t vbase, vaddr_t vend, int perms) {
+	region->vbase = vbase;
+	region->vend = vend;
+	region->offset = 0;
+	region->filesize = 0;
+	region->is_executable = (perms & REGION_EXEC) != 0;
+	region->perms = perms;
+	region->v = NULL;
+	region->shared = 0;
+	region->cached = 0;
+	region->numPages = 0;
+	region->cluster = CLUSTER_START;
+	region->nextFault = 0;
+	region->advice = MADV_NORMAL;
+}
+
+//Index of the first region that starts above VADDR, i.e. where a region starting at VADDR belongs
+static int regionSlot(struct addrspace* as, vaddr_t vaddr) {
+	int low = 0, high = as->numRegions;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if ((as->regions[mid])->vbase <= vaddr) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+Region* as_findregion(struct addrspace* as, vaddr_t vaddr) {
+	//Only the last region starting at or below vaddr can contain it
+	int i = regionSlot(as, vaddr);
+	if (i > 0 && vaddr < (as->regions[i-1])->vend) {
+		return as->regions[i-1];
+	}
+	return NULL;
+}
+
+Region* as_regionof(struct addrspace* as, vaddr_t vaddr) {
+	Region* region = as_findregion(as, vaddr);
+
+	if (region != NULL) {
+		return region;
+	}
+	if (betweenVals(vaddr, (as->heap).vbase, ((as->heap).vend + PAGE_SIZE - 1) & PAGE_FRAME)) {
+		return &(as->heap);
+	}
+	if (betweenVals(vaddr, USERSTACK - STACKLIMIT, (as->stack).vend)) {
+		return &(as->stack);
+	}
+	return NULL;
+}
+
+//Put REGION in the table in base address order, growing the table if it is full
+static int insertRegion(struct addrspace* as, Region* region) {
+	int i;
+
+	if (as->numRegions == as->maxRegions) {
+		int newmax = (as->maxRegions == 0) ? REGIONS_START : as->maxRegions * 2;
+		Region** newregions = kmalloc(newmax * sizeof(Region*));
+		if (newregions == NULL) {
 			return ENOMEM;
-		current->next = NULL;
-		temp+= PAGE_SIZE;
+		}
+		if (as->regions != NULL) {
+			memcpy(newregions, as->regions, as->numRegions * sizeof(Region*));
+			kfree(as->regions);
+		}
+		as->regions = newregions;
+		as->maxRegions = newmax;
 	}
+
+	i = regionSlot(as, region->vbase);
+	memmove(&as->regions[i+1], &as->regions[i], (as->numRegions - i) * sizeof(Region*));
+	as->regions[i] = region;
+	as->numRegions++;
 	return 0;
 }
 
-static void destroyPageTable (Region* region) {
+//Create a region of NPAGES pages at VADDR (page aligned) and add it to the table
+static int newRegion(struct addrspace* as, vaddr_t vaddr, size_t npages, int perms, Region** ret) {
+	vaddr_t vend = vaddr + npages * PAGE_SIZE;
+	Region* region;
+	int i, result;
+
+	//The end of the region is exclusive. Check the neighbours on both sides for overlap
+	i = regionSlot(as, vaddr);
+	if ((i > 0 && (as->regions[i-1])->vend > vaddr) ||
+	    (i < as->numRegions && (as->regions[i])->vbase < vend)) {
+		return EINVAL;
+	}
+
+	region = kmalloc(sizeof(Region));
+	if (region == NULL) {
+		return ENOMEM;
+	}
+	initRegion(region, vaddr, vend, perms);
+
+	result = insertRegion(as, region);
+	if (result) {
+		kfree(region);
+		return result;
+	}
+	*ret = region;
+	return 0;
+}
+
+int as_define_mapping(struct addrspace* as, struct vnode* v, off_t offset, size_t filesize, size_t sz,
+		      int perms, int shared, vaddr_t* ret) {
+	vaddr_t start = ((as->heap).vbase + HEAPLIMIT + PAGE_SIZE - 1) & PAGE_FRAME;
+	vaddr_t limit = USERSTACK - STACKLIMIT;
+	size_t npages = (sz + PAGE_SIZE - 1) / PAGE_SIZE;
+	Region* region;
+	int i, result;
+
+	//First fit: walk the regions from the bottom of the mmap area until a gap is big enough
+	i = regionSlot(as, start);
+	if (i > 0 && (as->regions[i-1])->vend > start) {
+		start = (as->regions[i-1])->vend;
+	}
+	for (; i < as->numRegions; i++) {
+		if ((as->regions[i])->vbase >= start + npages * PAGE_SIZE) {
+			break;
+		}
+		start = maximum(start, (as->regions[i])->vend);
+	}
+	if (npages == 0 || start + npages * PAGE_SIZE > limit || start + npages * PAGE_SIZE < start) {
+		return ENOMEM;
+	}
+
+	result = newRegion(as, start, npages, perms, &region);
+	if (result) {
+		return result;
+	}
+	VOP_INCREF(v);
+	region->v = v;
+	region->offset = offset;
+	region->filesize = filesize;
+	region->shared = shared;
+	region->cached = !shared;
+	*ret = start;
+	return 0;
+}
+
+int as_syncregion(struct addrspace* as, Region* region) {
+	PageTableEntry* entry;
+	paddr_t paddr;
+	vaddr_t vaddr;
+	size_t regionoffset, len;
+	struct uio ku;
+	int spl, result;
+
+	vaddr = region->vbase;
+	while (vaddr < region->vend) {
+		regionoffset = vaddr - region->vbase;
+		if (regionoffset >= region->filesize) {
+			//Past the end of the file; nothing more to write
+			break;
+		}
+
+		entry = pt_lookup(as->pagetable, vaddr);
+		if (entry == NULL) {
+			vaddr = (vaddr & ~(vaddr_t)(PT_TABLESPAN - 1)) + PT_TABLESPAN;
+			continue;
+		}
+
+		//Changed pages that went to the swap disk have to come back to be written out
+		if (PTE_ISSWAPPED(*entry) && (*entry & TLBLO_DIRTY)) {
+			result = swap_in(as, vaddr, entry);
+			if (result) {
+				return result;
+			}
+			continue;
+		}
+
+		//Shared file pages are mapped read-only until written, so the dirty bit means changed.
+		//Clear it first: a write during the write-back marks it again and it goes out next time.
+		spl = splhigh();
+		if (!PTE_PRESENT(*entry) || !(*entry & TLBLO_DIRTY)) {
+			splx(spl);
+			vaddr += PAGE_SIZE;
+			continue;
+		}
+		*entry &= ~TLBLO_DIRTY;
+		tlb_shootdown(as, vaddr);
+		paddr = PTE_PADDR(*entry);
+		//Our mapping keeps the frame allocated; untracked, the pager leaves it alone while the write sleeps
+		swap_untrack(paddr);
+		splx(spl);
+
+		len = region->filesize - regionoffset;
+		if (len > PAGE_SIZE) {
+			len = PAGE_SIZE;
+		}
+		mk_kuio(&ku, (void*)PADDR_TO_KVADDR(paddr), len, region->offset + regionoffset, UIO_WRITE);
+		result = VOP_WRITE(region->v, &ku);
+
+		spl = splhigh();
+		if (ourcoremap[(paddr - firstpaddr)/PAGE_SIZE].state == 1) {
+			swap_track(paddr, as, vaddr);
+		}
+		splx(spl);
+		if (result) {
+			return result;
+		}
+
+		//Anything cached for this part of the file is out of date now
+		pagecache_forget(region->v, region->offset + regionoffset);
+		vaddr += PAGE_SIZE;
+	}
+	return 0;
+}
+
+void as_discard(struct addrspace* as, Region* region, vaddr_t start, vaddr_t end) {
+	PageTableEntry old;
+	vaddr_t vaddr;
 	int spl;
-	spl = splhigh();
-	PageTable temp;
-	int cmIndex;
-	while (region->localPageTable != NULL) {
-		temp = region->localPageTable;
-		cmIndex = (temp->paddr - firstpaddr)/PAGE_SIZE;
-		ourcoremap[cmIndex].state--; //state-- rather than CM_FREE
-		region->localPageTable = (region->localPageTable)->next;
-		kfree(temp);
+
+	//Wait out a page-out of any of these pages, so its slot is not freed under the write
+	swap_lock();
+	for (vaddr = start; vaddr < end; vaddr += PAGE_SIZE) {
+		spl = splhigh();
+		old = pt_remove(as->pagetable, vaddr);
+		if (PTE_PRESENT(old)) {
+			//The frame may be reused, so the TLB must forget it first
+			tlb_shootdown(as, vaddr);
+			releasePage(PTE_PADDR(old));
+			VMSTAT_INC(as, vs_pagefree);
+			region->numPages--;
+		}
+		else if (PTE_ISSWAPPED(old)) {
+			swap_free(old);
+			region->numPages--;
+		}
+		splx(spl);
 	}
-	splx(spl);
-	return;
+	swap_unlock();
+	//A fault-around run that was going on is over
+	region->nextFault = 0;
+}
+
+int as_removeregion(struct addrspace* as, Region* region) {
+	int i, result;
+
+	if (region->shared) {
+		result = as_syncregion(as, region);
+		if (result) {
+			return result;
+		}
+	}
+
+	as_discard(as, region, region->vbase, region->vend);
+
+	i = regionSlot(as, region->vbase) - 1;
+	assert(i >= 0 && as->regions[i] == region);
+	memmove(&as->regions[i], &as->regions[i+1], (as->numRegions - i - 1) * sizeof(Region*));
+	as->numRegions--;
+
+	if (region->v != NULL) {
+		VOP_DECREF(region->v);
+	}
+	kfree(region);
+	return 0;
 }
 
-int as_copy_region(Region* old, Region* new) {
+//Copy a region's description, then share every resident page in [start, end) with the new page table.
+//Both sides lose write access to the shared frames; the first write to one makes a private copy (see vm_fault).
+//Pages the parent has on the swap disk are read back in first so they can be shared the same way.
+int as_copy_region(struct addrspace* oldas, Region* old, Region* new, PageTable* newpt, vaddr_t start, vaddr_t end) {
+	int spl, result;
+
 	//Copy the virtual addresses for the regions
 	new->vbase = old->vbase;
 	new->vend = old->vend;
 	new->numPages = old->numPages;
+	new->offset = old->offset;
+	new->filesize = old->filesize;
+	new->is_executable = old->is_executable;
+	new->perms = old->perms;
+	new->shared = old->shared;
+	new->cached = old->cached;
+	new->v = old->v;
+	if (new->v != NULL) {
+		VOP_INCREF(new->v);
+	}
+	new->cluster = old->cluster;
+	new->nextFault = old->nextFault;
+	new->advice = old->advice;
+
+	vaddr_t vaddr = start;
+	while (vaddr < end) {
+		PageTableEntry* source = pt_lookup(oldas->pagetable, vaddr);
+
+		//Nothing mapped in this whole second-level table, skip to the next one
+		if (source == NULL) {
+			vaddr = (vaddr & ~(vaddr_t)(PT_TABLESPAN - 1)) + PT_TABLESPAN;
+			continue;
+		}
 
-	//Do a deep copy of the localPageTable
-	PageTable source = old->localPageTable;
-	PageTable target;
-
-	//int spl = splhigh();
-	if(source == NULL) target = NULL;
-	else target = kmalloc(sizeof(PageTableEntry));
-	if(target == NULL && source != NULL) return ENOMEM;
-
-	while(source != NULL) {
-		target->vaddr = source->vaddr;
-		target->paddr = getppages(1);
-		target->next = NULL;
-
-		if (target->paddr == (paddr_t)0) {
-			//splx(spl);
-			return ENOMEM;
+		//Read with interrupts on; it may be paged out again before we get to share it, so look again
+		if (PTE_ISSWAPPED(*source)) {
+			result = swap_in(oldas, vaddr, source);
+			if (result) {
+				return result;
+			}
+			continue;
 		}
-		
-		//void *memmove(dest, source const void *, sizesize_t);
-		memmove((void*)PADDR_TO_KVADDR(target->paddr), (const void *)PADDR_TO_KVADDR(source->paddr), PAGE_SIZE);
-		source = source->next;
-		if (source != NULL) {
-			target->next = kmalloc(sizeof(PageTableEntry));
-			if(target == NULL) {
-				///splx(spl);
+
+		//Keep the pager from taking the page between checking it and sharing it
+		spl = splhigh();
+		if (PTE_PRESENT(*source)) {
+			//Shared file mappings stay shared for real; everything else is copied on write
+			if (!old->shared && (*source & TLBLO_DIRTY)) {
+				*source = (*source & ~TLBLO_DIRTY) | PTE_COW;
+			}
+			if (pt_insert(newpt, vaddr, *source)) {
+				splx(spl);
 				return ENOMEM;
 			}
+			sharePage(PTE_PADDR(*source));
+			VMSTAT_INC(oldas, vs_forkshared);
 		}
+		splx(spl);
+		vaddr += PAGE_SIZE;
 	}
-	//splx(spl);
 	return 0;
 }
 
 //Initialize an addr space
 struct addrspace* as_create(void) {
 	struct addrspace *as = kmalloc(sizeof(struct addrspace));
+	int spl;
 	if (as==NULL) {
 		return NULL;
 	}
@@ -127,25 +407,55 @@ struct addrspace* as_create(void) {
 	 */
 	//OUR Implementation
 
-	(as->region1).vend = (as->region1).vbase = (vaddr_t)0;
-	(as->region1).localPageTable = NULL;
-	(as->region1).numPages = 0;
+	as->pagetable = pt_create();
+	if (as->pagetable == NULL) {
+		kfree(as);
+		return NULL;
+	}
+	as->asid = 0;
+	as->asidGeneration = 0;
+	bzero(&as->stats, sizeof(struct vmstats));
 
-	(as->region2).vend = (as->region2).vbase = (vaddr_t)0;
-	(as->region2).localPageTable = NULL;
-	(as->region2).numPages = 0;
+	//The table is allocated when the first region is defined
+	as->regions = NULL;
+	as->numRegions = 0;
+	as->maxRegions = 0;
 
-	(as->heap).vend = (as->heap).vbase = (vaddr_t)0;
-	(as->heap).localPageTable = NULL;
-	(as->heap).numPages = 0;
+	initRegion(&(as->heap), 0, 0, REGION_READ | REGION_WRITE);
+	initRegion(&(as->stack), 0, 0, REGION_READ | REGION_WRITE);
 
-	(as->stack).vend = (as->stack).vbase = (vaddr_t)0;
-	(as->stack).localPageTable = NULL;
-	(as->stack).numPages = 0;
+	spl = splhigh();
+	as->nextas = allspaces;
+	allspaces = as;
+	splx(spl);
 	
 	return as;
 }
 
+void as_retrack(void) {
+	struct addrspace* as;
+	PageTableEntry* table;
+	paddr_t paddr;
+	int cmIndex;
+	unsigned i, j;
+
+	assert(curspl > 0);
+	for (as = allspaces; as != NULL; as = as->nextas) {
+		for (i = 0; i < PT_NUMDIRS; i++) {
+			table = as->pagetable->tables[i];
+			if (table == NULL) continue;
+			for (j = 0; j < PT_NUMENTRIES; j++) {
+				if (!PTE_PRESENT(table[j])) continue;
+				paddr = PTE_PADDR(table[j]);
+				cmIndex = (paddr - firstpaddr)/PAGE_SIZE;
+				if (ourcoremap[cmIndex].unshared && ourcoremap[cmIndex].state == 1 && !ourcoremap[cmIndex].busy) {
+					swap_track(paddr, as, (i << PT_DIRSHIFT) | (j << PT_ENTRYSHIFT));
+				}
+			}
+		}
+	}
+}
+
 int as_copy(struct addrspace *old, struct addrspace **ret) {
 	//DUMBVM Implemenation
 	// 	struct addrspace *new;
@@ -196,15 +506,36 @@ int as_copy(struct addrspace *old, struct addrspace **ret) {
 	 */
 
 
-	//Copy the regions one by one
-	int result = as_copy_region(&(old->region1), &(newas->region1));
-	if(result) return result;
-	result = as_copy_region(&(old->region2), &(newas->region2));
-	if(result) return result;
-	result = as_copy_region(&(old->stack), &(newas->stack));
-	if(result) return result;
-	result = as_copy_region(&(old->heap), &(newas->heap));
-	if(result) return result;
+	//Copy the regions one by one (the stack's pages live below its base)
+	int result = 0;
+	int i;
+	for (i = 0; i < old->numRegions && !result; i++) {
+		Region* region = kmalloc(sizeof(Region));
+		if (region == NULL) {
+			result = ENOMEM;
+			break;
+		}
+		//In the table before anything can fail, so as_destroy cleans it up
+		initRegion(region, (old->regions[i])->vbase, (old->regions[i])->vend, 0);
+		result = insertRegion(newas, region);
+		if (result) {
+			kfree(region);
+			break;
+		}
+		result = as_copy_region(old, old->regions[i], region, newas->pagetable,
+			(old->regions[i])->vbase, (old->regions[i])->vend);
+	}
+	if(!result) result = as_copy_region(old, &(old->stack), &(newas->stack), newas->pagetable,
+		USERSTACK - STACKLIMIT, USERSTACK);
+	if(!result) result = as_copy_region(old, &(old->heap), &(newas->heap), newas->pagetable,
+		(old->heap).vbase, (old->heap).vend);
+	if(result) {
+		as_destroy(newas);
+		return result;
+	}
+
+	//The parent's TLB may still allow writes to pages that are now shared
+	tlb_flush_as(old);
 
 	//newas->as_stackpbase = newas->as_stackpbase;
 	
@@ -218,34 +549,40 @@ void as_destroy(struct addrspace *as) {
 	 */
 
 	//TODO: make this atomic
-	destroyPageTable(&(as->region1));
-	destroyPageTable(&(as->region2));
-	destroyPageTable(&(as->heap));
-	destroyPageTable(&(as->stack));
+	struct addrspace **prev;
+	int i, spl;
 
-	kfree(as);
-}
-
-void as_activate(struct addrspace *as) {
-	//DUMBVM Implementation
-	 	int i, spl;
+	//The pager must not go looking for pages in here any more
+	spl = splhigh();
+	for (prev = &allspaces; *prev != as; prev = &(*prev)->nextas);
+	*prev = as->nextas;
+	splx(spl);
 
-	 	(void)as;
+	//Shared file mappings write their changes back (there is no one to report a failure to)
+	for (i = 0; i < as->numRegions; i++) {
+		if ((as->regions[i])->shared) {
+			as_syncregion(as, as->regions[i]);
+		}
+	}
 
-	 	spl = splhigh();
-		
-		//NUM_TLB is defined as 64 elsewhere
-		for (i=0; i<NUM_TLB; i++) {
-			TLB_Write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	tlb_release(as);
+	destroyPageTable(as);
+	for (i = 0; i < as->numRegions; i++) {
+		if ((as->regions[i])->v != NULL) {
+			VOP_DECREF((as->regions[i])->v);
 		}
+		kfree(as->regions[i]);
+	}
+	if (as->regions != NULL) {
+		kfree(as->regions);
+	}
 
-		splx(spl);
-	
-	/*
-	 * Write this.
-	 */
+	kfree(as);
+}
 
-	(void)as;  // suppress warning until code gets written
+void as_activate(struct addrspace *as) {
+	//Entries are tagged with the address space's ASID, so switching just changes which ones match
+	tlb_activate(as);
 }
 
 /*
@@ -254,9 +591,11 @@ void as_activate(struct addrspace *as) {
  * VADDR+MEMSIZE.
  *
  * The READABLE, WRITEABLE, and EXECUTABLE flags are set if read,
- * write, or execute permission should be set on the segment. At the
- * moment, these are ignored. When you write the VM system, you may
- * want to implement them.
+ * write, or execute permission should be set on the segment. Writes
+ * to a region without write permission fault with EFAULT once its
+ * pages are loaded.
+ *
+ * Regions may not overlap each other (EINVAL).
  */
 int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 		 int readable, int writeable, int executable) {
@@ -265,6 +604,8 @@ int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 	 */
 
 	size_t npages; 
+	Region* region;
+	int result;
 
 	/* Align the region. First, the base... */
 	sz += vaddr & ~(vaddr_t)PAGE_FRAME;
@@ -274,27 +615,18 @@ int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 	sz = (sz + PAGE_SIZE - 1) & PAGE_FRAME;
 
 	npages = sz / PAGE_SIZE;
-
-	//TODO: fix
-	//TODO: is the end of the region inclusive? for now write as exclusive
-	if((as->region1).vbase == 0) {
-		(as->region1).vbase = vaddr;
-		(as->region1).vend = vaddr + (npages*PAGE_SIZE);
-		(as->region1).numPages = npages;
+	if (npages == 0) {
+		return 0;
 	}
-	else if((as->region2).vbase == 0) {
-		(as->region2).vbase = vaddr;
-		(as->region2).vend = vaddr + (npages * PAGE_SIZE);
-		(as->region2).numPages = npages;	
+
+	result = newRegion(as, vaddr, npages,
+		(readable ? REGION_READ : 0) | (writeable ? REGION_WRITE : 0) | (executable ? REGION_EXEC : 0), &region);
+	if (result) {
+		return result;
 	}
+	region->numPages = npages;
 	return 0;
 
-
-	/* We don't use these - all pages are read-write */
-	(void)readable;
-	(void)writeable;
-	(void)executable;
-
 // 	if (as->as_vbase1 == 0) {
 // 		as->as_vbase1 = vaddr;
 // 		as->as_npages1 = npages;
@@ -307,12 +639,6 @@ int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 // 		return 0;
 // 	}
 
-	/*
-	 * Support for more than two regions is not available.
-	 */
-	kprintf("VM: Warning: too many regions\n");
-	return EUNIMP;
-
 	// (void)as;
 	// (void)vaddr;
 	// (void)sz;
@@ -380,7 +706,8 @@ int as_complete_load(struct addrspace *as) {
 	(as->stack).numPages = 0;
 	
 	//Look for the maximum address based on the regions list and start the heap there
-	(as->heap).vend = (as->heap).vbase = maximum((as->region1).vend, (as->region2).vend);
+	//(the table is sorted, so that is the end of the last region)
+	(as->heap).vend = (as->heap).vbase = (as->numRegions > 0) ? (as->regions[as->numRegions - 1])->vend : 0;
 
 	return 0;
 }
@@ -0,0 +1,278 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <pagetable.h>
+#include <swap.h>
+#include <ksm.h>
+#include <machine/spl.h>
+#include <ourextern.h>
+
+/*
+ * Samepage merging. See ksm.h.
+ */
+
+#define KSM_BUCKETS 64
+
+//Where a frame is in the merger's tables
+#define KSM_NONE     0
+#define KSM_UNSTABLE 1  /* seen this pass, still private */
+#define KSM_STABLE   2  /* merged, mapped read-only everywhere */
+
+//Per-frame bookkeeping, indexed like the coremap (allocated on the first scan)
+typedef struct ksmFrame {
+	u_int32_t hash;
+	int next;   //bucket chain (coremap indexes, -1 terminated)
+	int state;
+} KsmFrame;
+
+static KsmFrame* frames = NULL;
+static int stableBuckets[KSM_BUCKETS];
+static int unstableBuckets[KSM_BUCKETS];
+static int stableFrames = 0;
+
+//Next coremap index to look at, and how many user pages had been allocated when the last pass ended
+static int cursor = 0;
+static u_int32_t passAllocs = 0;
+static int passDone = 0;
+
+int ksm_enabled = 1;
+unsigned long ksm_pages_scanned = 0;
+unsigned long ksm_pages_merged = 0;
+unsigned long ksm_pages_unmerged = 0;
+static unsigned long ksm_zero_merged = 0;
+static unsigned long ksm_passes = 0;
+
+static int setupFrames(void) {
+	int i;
+
+	frames = kmalloc(totalpages * sizeof(KsmFrame));
+	if (frames == NULL) {
+		return ENOMEM;
+	}
+	for (i = 0; i < totalpages; i++) {
+		frames[i].next = -1;
+		frames[i].state = KSM_NONE;
+	}
+	for (i = 0; i < KSM_BUCKETS; i++) {
+		stableBuckets[i] = unstableBuckets[i] = -1;
+	}
+	return 0;
+}
+
+//Hash a page, and say whether it is all zeros
+static u_int32_t hashPage(paddr_t paddr, int* zero) {
+	const u_int32_t* words = (const u_int32_t*)PADDR_TO_KVADDR(paddr);
+	u_int32_t hash = 0, any = 0;
+	unsigned i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(u_int32_t); i++) {
+		hash = ((hash << 5) | (hash >> 27)) ^ words[i];
+		any |= words[i];
+	}
+	*zero = (any == 0);
+	return hash;
+}
+
+//The kernel has no memcmp; compare a word at a time
+static int samePage(int index1, int index2) {
+	const u_int32_t* a = (const u_int32_t*)PADDR_TO_KVADDR(firstpaddr + index1 * PAGE_SIZE);
+	const u_int32_t* b = (const u_int32_t*)PADDR_TO_KVADDR(firstpaddr + index2 * PAGE_SIZE);
+	unsigned i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(u_int32_t); i++) {
+		if (a[i] != b[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void chainRemove(int* buckets, int index) {
+	int* prev;
+
+	for (prev = &buckets[frames[index].hash % KSM_BUCKETS]; *prev != -1; prev = &frames[*prev].next) {
+		if (*prev == index) {
+			*prev = frames[index].next;
+			frames[index].next = -1;
+			return;
+		}
+	}
+}
+
+static void chainAdd(int* buckets, int index, int state) {
+	int b = frames[index].hash % KSM_BUCKETS;
+
+	frames[index].next = buckets[b];
+	frames[index].state = state;
+	buckets[b] = index;
+}
+
+//Find a frame with the same contents as INDEX in one of the tables (-1 if there is none)
+static int findMatch(int* buckets, int index) {
+	int i;
+
+	for (i = buckets[frames[index].hash % KSM_BUCKETS]; i != -1; i = frames[i].next) {
+		if (i != index && frames[i].hash == frames[index].hash && samePage(i, index)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+//A private page that can be merged: mapped by one page table, not being filled or written out,
+//and not part of a shared file mapping
+static int candidate(int index) {
+	Region* region;
+
+	if (ourcoremap[index].state != 1 || ourcoremap[index].owner == NULL || ourcoremap[index].busy
+	    || ourcoremap[index].order != 0) {
+		return 0;
+	}
+	region = as_findregion(ourcoremap[index].owner, ourcoremap[index].vaddr);
+	return region == NULL || !region->shared;
+}
+
+//The entry mapping the private page at INDEX
+static PageTableEntry* ownerEntry(int index) {
+	PageTableEntry* entry = pt_lookup(ourcoremap[index].owner->pagetable, ourcoremap[index].vaddr);
+
+	assert(entry != NULL && PTE_PRESENT(*entry));
+	assert(PTE_PADDR(*entry) == firstpaddr + index * PAGE_SIZE);
+	return entry;
+}
+
+//Point the private page at INDEX to the frame TARGET (which already has a reference for it) and free it
+static void remapTo(int index, paddr_t target) {
+	struct addrspace* owner = ourcoremap[index].owner;
+	vaddr_t vaddr = ourcoremap[index].vaddr;
+	PageTableEntry* entry = ownerEntry(index);
+
+	*entry = target | TLBLO_VALID | PTE_COW | PTE_MERGED;
+	tlb_shootdown(owner, vaddr);
+	releasePage(firstpaddr + index * PAGE_SIZE);
+	VMSTAT_INC(owner, vs_pagefree);
+	ksm_pages_merged++;
+}
+
+//Turn the private page at INDEX into a merged frame: read-only for its owner from now on.
+//HASH is what its contents hash to now (it may have changed since it went in the unstable table).
+static void makeStable(int index, u_int32_t hash) {
+	PageTableEntry* entry = ownerEntry(index);
+
+	*entry = (*entry & ~TLBLO_DIRTY) | PTE_COW | PTE_MERGED;
+	tlb_shootdown(ourcoremap[index].owner, ourcoremap[index].vaddr);
+	chainRemove(unstableBuckets, index);
+	frames[index].hash = hash;
+	chainAdd(stableBuckets, index, KSM_STABLE);
+	stableFrames++;
+}
+
+static void scanPage(int index) {
+	paddr_t paddr = firstpaddr + index * PAGE_SIZE;
+	int zero, match;
+
+	frames[index].hash = hashPage(paddr, &zero);
+	ksm_pages_scanned++;
+
+	//Zeros go to the zero page, which every address space maps read-only already
+	if (zero) {
+		ourcoremap[(zeroPage - firstpaddr)/PAGE_SIZE].state++;
+		remapTo(index, zeroPage);
+		ksm_zero_merged++;
+		return;
+	}
+
+	match = findMatch(stableBuckets, index);
+	if (match == -1) {
+		match = findMatch(unstableBuckets, index);
+		//It has to still be private for us to take write access away from its owner
+		if (match != -1 && !candidate(match)) {
+			match = -1;
+		}
+		if (match != -1) {
+			makeStable(match, frames[index].hash);
+		}
+	}
+	if (match != -1) {
+		//Taking a reference stops the pager from considering it (sharePage untracks it)
+		sharePage(firstpaddr + match * PAGE_SIZE);
+		remapTo(index, firstpaddr + match * PAGE_SIZE);
+		return;
+	}
+
+	if (frames[index].state == KSM_NONE) {
+		chainAdd(unstableBuckets, index, KSM_UNSTABLE);
+	}
+}
+
+//A pass is over: forget the unstable table (its pages may have changed since they were hashed)
+static void endPass(void) {
+	int b, i, next;
+
+	for (b = 0; b < KSM_BUCKETS; b++) {
+		for (i = unstableBuckets[b]; i != -1; i = next) {
+			next = frames[i].next;
+			frames[i].next = -1;
+			frames[i].state = KSM_NONE;
+		}
+		unstableBuckets[b] = -1;
+	}
+	cursor = 0;
+	passAllocs = vm_globalstats.vs_pagealloc;
+	passDone = 1;
+	ksm_passes++;
+}
+
+int ksm_scan(void) {
+	int budget = KSM_SCANBUDGET;
+
+	assert(curspl > 0);
+	if (!ksm_enabled || zeroPage == (paddr_t)0) {
+		return 0;
+	}
+	if (frames == NULL && setupFrames()) {
+		return 0;
+	}
+	//Nothing new since the last pass
+	if (passDone && vm_globalstats.vs_pagealloc == passAllocs) {
+		return 0;
+	}
+	passDone = 0;
+
+	while (budget > 0 && cursor < totalpages) {
+		if (candidate(cursor)) {
+			scanPage(cursor);
+			budget--;
+		}
+		cursor++;
+	}
+	if (cursor >= totalpages) {
+		endPass();
+	}
+	return 1;
+}
+
+void ksm_forget(paddr_t paddr) {
+	int spl;
+	int index = (paddr - firstpaddr)/PAGE_SIZE;
+
+	if (frames == NULL) {
+		return;
+	}
+	spl = splhigh();
+	if (frames[index].state == KSM_STABLE) {
+		chainRemove(stableBuckets, index);
+		frames[index].state = KSM_NONE;
+		stableFrames--;
+	}
+	splx(spl);
+}
+
+void ksm_printstats(void) {
+	kprintf("KSM (%s): %lu pages scanned in %lu passes, %d merged frames\n",
+		ksm_enabled ? "on" : "off", ksm_pages_scanned, ksm_passes, stableFrames);
+	kprintf("     %lu pages merged (%lu into the zero page), %lu unmerged by writes\n",
+		ksm_pages_merged, ksm_zero_merged, ksm_pages_unmerged);
+}
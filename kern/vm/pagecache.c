@@ -0,0 +1,125 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <vnode.h>
+#include <vm.h>
+#include <pagecache.h>
+#include <machine/spl.h>
+#include <ourextern.h>
+
+/*
+ * Shared executable page cache. See pagecache.h.
+ */
+
+#define PC_BUCKETS 64
+
+typedef struct pageCacheEntry {
+	struct vnode* v;
+	off_t offset;
+	paddr_t paddr;
+	struct pageCacheEntry* next;
+} PageCacheEntry;
+
+static PageCacheEntry* buckets[PC_BUCKETS];
+static int cachedPages = 0;
+
+static unsigned long pc_hits = 0;
+static unsigned long pc_misses = 0;
+
+static unsigned bucketFor(struct vnode* v, off_t offset) {
+	return (((u_int32_t)v >> 4) ^ ((u_int32_t)offset >> 12)) % PC_BUCKETS;
+}
+
+paddr_t pagecache_lookup(struct vnode* v, off_t offset) {
+	int spl = splhigh();
+	PageCacheEntry* e;
+
+	for (e = buckets[bucketFor(v, offset)]; e != NULL; e = e->next) {
+		if (e->v == v && e->offset == offset) {
+			sharePage(e->paddr);
+			pc_hits++;
+			splx(spl);
+			return e->paddr;
+		}
+	}
+	pc_misses++;
+	splx(spl);
+	return (paddr_t)0;
+}
+
+int pagecache_insert(struct vnode* v, off_t offset, paddr_t paddr) {
+	PageCacheEntry* e = kmalloc(sizeof(PageCacheEntry));
+	unsigned b = bucketFor(v, offset);
+	int spl;
+
+	if (e == NULL) {
+		return ENOMEM;
+	}
+	e->v = v;
+	e->offset = offset;
+	e->paddr = paddr;
+
+	spl = splhigh();
+	//The cache's own references keep the frame and the vnode (and so the key) alive
+	sharePage(paddr);
+	VOP_INCREF(v);
+	e->next = buckets[b];
+	buckets[b] = e;
+	cachedPages++;
+	splx(spl);
+	return 0;
+}
+
+int pagecache_shrink(void) {
+	PageCacheEntry **prev, *e;
+	int freed = 0;
+	unsigned b;
+	int spl;
+
+	for (b = 0; b < PC_BUCKETS; b++) {
+		spl = splhigh();
+		prev = &buckets[b];
+		while ((e = *prev) != NULL) {
+			//Only the cache maps it
+			if (ourcoremap[(e->paddr - firstpaddr)/PAGE_SIZE].state == 1) {
+				*prev = e->next;
+				cachedPages--;
+				releasePage(e->paddr);
+				//Dropping the vnode can mean filesystem I/O, so not with interrupts off
+				splx(spl);
+				VOP_DECREF(e->v);
+				kfree(e);
+				freed++;
+				spl = splhigh();
+				prev = &buckets[b];
+				continue;
+			}
+			prev = &e->next;
+		}
+		splx(spl);
+	}
+	return freed;
+}
+
+void pagecache_forget(struct vnode* v, off_t offset) {
+	PageCacheEntry **prev, *e;
+	int spl = splhigh();
+
+	for (prev = &buckets[bucketFor(v, offset)]; (e = *prev) != NULL; prev = &e->next) {
+		if (e->v == v && e->offset == offset) {
+			*prev = e->next;
+			cachedPages--;
+			releasePage(e->paddr);
+			splx(spl);
+			VOP_DECREF(e->v);
+			kfree(e);
+			return;
+		}
+	}
+	splx(spl);
+}
+
+void pagecache_printstats(void) {
+	kprintf("Page cache: %d pages cached, %lu hits, %lu misses\n",
+		cachedPages, pc_hits, pc_misses);
+}
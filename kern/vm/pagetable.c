@@ -0,0 +1,76 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <vm.h>
+#include <pagetable.h>
+
+/*
+ * Two-level page table. See pagetable.h.
+ *
+ * Lookup, insert and remove are all two array indexes, so the cost of
+ * a fault no longer depends on how many pages the process has resident.
+ */
+
+PageTable* pt_create(void) {
+	PageTable* pt = kmalloc(sizeof(PageTable));
+	if (pt == NULL) {
+		return NULL;
+	}
+	bzero(pt, sizeof(PageTable));
+	return pt;
+}
+
+PageTableEntry* pt_lookup(PageTable* pt, vaddr_t vaddr) {
+	PageTableEntry* table;
+
+	assert(vaddr < USERTOP);
+
+	table = pt->tables[PT_DIRINDEX(vaddr)];
+	if (table == NULL) {
+		return NULL;
+	}
+	return &table[PT_ENTRYINDEX(vaddr)];
+}
+
+int pt_insert(PageTable* pt, vaddr_t vaddr, PageTableEntry entry) {
+	PageTableEntry* table;
+
+	assert(vaddr < USERTOP);
+
+	//Allocate the second-level table the first time its range is used
+	table = pt->tables[PT_DIRINDEX(vaddr)];
+	if (table == NULL) {
+		table = kmalloc(PAGE_SIZE);
+		if (table == NULL) {
+			return ENOMEM;
+		}
+		bzero(table, PAGE_SIZE);
+		pt->tables[PT_DIRINDEX(vaddr)] = table;
+	}
+
+	table[PT_ENTRYINDEX(vaddr)] = entry;
+	return 0;
+}
+
+PageTableEntry pt_remove(PageTable* pt, vaddr_t vaddr) {
+	PageTableEntry* entry = pt_lookup(pt, vaddr);
+	PageTableEntry old;
+
+	if (entry == NULL) {
+		return 0;
+	}
+	old = *entry;
+	*entry = 0;
+	return old;
+}
+
+void pt_destroy(PageTable* pt) {
+	unsigned i;
+
+	for (i = 0; i < PT_NUMDIRS; i++) {
+		if (pt->tables[i] != NULL) {
+			kfree(pt->tables[i]);
+		}
+	}
+	kfree(pt);
+}
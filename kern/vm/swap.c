@@ -0,0 +1,349 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/unistd.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <bitmap.h>
+#include <synch.h>
+#include <thread.h>
+#include <curthread.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <pagetable.h>
+#include <swap.h>
+#include <machine/spl.h>
+#include <machine/tlb.h>
+#include <ourextern.h>
+#include "opt-swapfifo.h"
+
+/*
+ * Swap disk and page replacement. See swap.h.
+ */
+
+static struct vnode* swapvnode = NULL;
+static struct bitmap* swapmap = NULL;
+static u_int32_t swapslots = 0;
+static u_int32_t swapslotsused = 0;
+
+//Serializes swap I/O so a page being written out is never read back half-done
+static struct lock* swaplock = NULL;
+
+//Evictable pages in the order they became resident (coremap indexes, -1 when empty).
+//The clock hand is always the head; pages that get a second chance go to the tail.
+static int residentHead = -1;
+static int residentTail = -1;
+static int residentCount = 0;
+
+//Frames flagged by swap_unshared that as_retrack has not looked for yet
+static int unsharedCount = 0;
+
+unsigned long swap_pageins = 0;
+unsigned long swap_pageouts = 0;
+
+void swap_bootstrap(void) {
+	char path[] = "lhd1raw:";
+	struct stat st;
+	int result;
+
+	swaplock = lock_create("swap");
+	if (swaplock == NULL) {
+		panic("swap: could not create lock\n");
+	}
+
+	result = vfs_open(path, O_RDWR, &swapvnode);
+	if (result) {
+		kprintf("swap: no swap disk (%s), paging out disabled\n", strerror(result));
+		swapvnode = NULL;
+		return;
+	}
+
+	result = VOP_STAT(swapvnode, &st);
+	if (result || st.st_size < PAGE_SIZE) {
+		kprintf("swap: cannot size swap disk, paging out disabled\n");
+		vfs_close(swapvnode);
+		swapvnode = NULL;
+		return;
+	}
+
+	swapslots = st.st_size / PAGE_SIZE;
+	swapmap = bitmap_create(swapslots);
+	if (swapmap == NULL) {
+		panic("swap: could not allocate slot bitmap\n");
+	}
+
+	kprintf("swap: %lu pages of swap on lhd1\n", (unsigned long)swapslots);
+}
+
+int swap_enabled(void) {
+	return swapvnode != NULL;
+}
+
+static void residentRemove(int index) {
+	if (ourcoremap[index].prev != -1) {
+		ourcoremap[ourcoremap[index].prev].next = ourcoremap[index].next;
+	}
+	else {
+		residentHead = ourcoremap[index].next;
+	}
+	if (ourcoremap[index].next != -1) {
+		ourcoremap[ourcoremap[index].next].prev = ourcoremap[index].prev;
+	}
+	else {
+		residentTail = ourcoremap[index].prev;
+	}
+	ourcoremap[index].next = ourcoremap[index].prev = -1;
+	residentCount--;
+}
+
+static void residentAppend(int index) {
+	ourcoremap[index].next = -1;
+	ourcoremap[index].prev = residentTail;
+	if (residentTail != -1) {
+		ourcoremap[residentTail].next = index;
+	}
+	else {
+		residentHead = index;
+	}
+	residentTail = index;
+	residentCount++;
+}
+
+static void unsharedClear(int index) {
+	if (ourcoremap[index].unshared) {
+		ourcoremap[index].unshared = 0;
+		unsharedCount--;
+	}
+}
+
+void swap_unshared(paddr_t paddr) {
+	int spl = splhigh();
+	int cmIndex = (paddr - firstpaddr)/PAGE_SIZE;
+
+	if (ourcoremap[cmIndex].owner == NULL && !ourcoremap[cmIndex].unshared) {
+		ourcoremap[cmIndex].unshared = 1;
+		unsharedCount++;
+	}
+	splx(spl);
+}
+
+//Find who maps the frames that went back to one reference and put them on the resident list.
+//Interrupts must be off.
+static void retrackUnshared(void) {
+	int i;
+
+	if (unsharedCount == 0) {
+		return;
+	}
+	as_retrack();
+	//Anything still flagged is not in any page table (only the page cache holds it)
+	for (i = 0; i < totalpages && unsharedCount > 0; i++) {
+		unsharedClear(i);
+	}
+}
+
+void swap_track(paddr_t paddr, struct addrspace* as, vaddr_t vaddr) {
+	int spl = splhigh();
+	int cmIndex = (paddr - firstpaddr)/PAGE_SIZE;
+
+	unsharedClear(cmIndex);
+	if (ourcoremap[cmIndex].owner == NULL) {
+		residentAppend(cmIndex);
+	}
+	ourcoremap[cmIndex].owner = as;
+	ourcoremap[cmIndex].vaddr = vaddr & PAGE_FRAME;
+	ourcoremap[cmIndex].referenced = 1;
+	splx(spl);
+}
+
+void swap_untrack(paddr_t paddr) {
+	int spl = splhigh();
+	int cmIndex = (paddr - firstpaddr)/PAGE_SIZE;
+
+	unsharedClear(cmIndex);
+	if (ourcoremap[cmIndex].owner != NULL) {
+		residentRemove(cmIndex);
+		ourcoremap[cmIndex].owner = NULL;
+	}
+	splx(spl);
+}
+
+//Pick the page to evict (a coremap index, or -1 if nothing is evictable). Interrupts must be off.
+static int chooseVictim(void) {
+#if OPT_SWAPFIFO
+	//Oldest resident page
+	return residentHead;
+#else
+	//Second chance: a referenced page loses its bit and goes to the back of the line.
+	//Two trips around is enough for the hand to come back to a page it cleared.
+	int budget = 2 * residentCount;
+	int index;
+	Region* region;
+
+	while (residentHead != -1 && budget-- > 0) {
+		index = residentHead;
+		if (!ourcoremap[index].referenced) {
+			return index;
+		}
+		//Memory the program said it streams through once gets no second chance
+		region = as_regionof(ourcoremap[index].owner, ourcoremap[index].vaddr);
+		if (region != NULL && region->advice == MADV_SEQUENTIAL) {
+			return index;
+		}
+		ourcoremap[index].referenced = 0;
+		//Make the next access fault so the bit gets set again (the fast refill in the
+		//exception vector leaves PTE_UNREF entries to vm_fault)
+		*pt_lookup(ourcoremap[index].owner->pagetable, ourcoremap[index].vaddr) |= PTE_UNREF;
+		tlb_shootdown(ourcoremap[index].owner, ourcoremap[index].vaddr);
+		residentRemove(index);
+		residentAppend(index);
+	}
+	return residentHead;
+#endif
+}
+
+int swap_evict(void) {
+	int holding, spl, victim;
+	u_int32_t slot;
+	struct addrspace* owner;
+	PageTableEntry* entry;
+	paddr_t paddr;
+	struct uio ku;
+	int result;
+
+	if (swapvnode == NULL) {
+		return ENOMEM;
+	}
+
+	//Paging in can need a frame, which can mean paging something else out first
+	holding = lock_do_i_hold(swaplock);
+	if (!holding) {
+		lock_acquire(swaplock);
+	}
+
+	spl = splhigh();
+	retrackUnshared();
+	victim = chooseVictim();
+	if (victim == -1 || bitmap_alloc(swapmap, &slot)) {
+		splx(spl);
+		if (!holding) {
+			lock_release(swaplock);
+		}
+		return ENOMEM;
+	}
+	swapslotsused++;
+
+	//Unmap it first; if the owner touches it before the write is done it waits on swaplock in swap_in
+	owner = ourcoremap[victim].owner;
+	entry = pt_lookup(owner->pagetable, ourcoremap[victim].vaddr);
+	assert(entry != NULL && PTE_PRESENT(*entry));
+	paddr = PTE_PADDR(*entry);
+	*entry = (slot << PT_ENTRYSHIFT) | PTE_SWAPPED | (*entry & (TLBLO_DIRTY | PTE_COW));
+	tlb_shootdown(owner, ourcoremap[victim].vaddr);
+	residentRemove(victim);
+	ourcoremap[victim].owner = NULL;
+	ourcoremap[victim].busy = 1;
+	//OWNER can be torn down once we drop swaplock, so no touching it after the write
+	swap_pageouts++;
+	VMSTAT_INC(owner, vs_swapouts);
+	splx(spl);
+
+	mk_kuio(&ku, (void*)PADDR_TO_KVADDR(paddr), PAGE_SIZE, slot * PAGE_SIZE, UIO_WRITE);
+	result = VOP_WRITE(swapvnode, &ku);
+	if (result) {
+		panic("swap: write to slot %lu failed: %s\n", (unsigned long)slot, strerror(result));
+	}
+
+	releasePage(paddr);
+
+	if (!holding) {
+		lock_release(swaplock);
+	}
+	return 0;
+}
+
+int swap_in(struct addrspace* as, vaddr_t vaddr, PageTableEntry* entry) {
+	int holding, spl;
+	u_int32_t slot;
+	paddr_t paddr;
+	struct uio ku;
+	int result;
+
+	holding = lock_do_i_hold(swaplock);
+	if (!holding) {
+		lock_acquire(swaplock);
+	}
+
+	//Someone else may have brought it back while we waited for the lock
+	if (!PTE_ISSWAPPED(*entry)) {
+		if (!holding) {
+			lock_release(swaplock);
+		}
+		return 0;
+	}
+	slot = PTE_SLOT(*entry);
+
+	paddr = getUserPage();
+	if (paddr == (paddr_t)0) {
+		if (!holding) {
+			lock_release(swaplock);
+		}
+		return ENOMEM;
+	}
+
+	mk_kuio(&ku, (void*)PADDR_TO_KVADDR(paddr), PAGE_SIZE, slot * PAGE_SIZE, UIO_READ);
+	result = VOP_READ(swapvnode, &ku);
+	if (result) {
+		panic("swap: read from slot %lu failed: %s\n", (unsigned long)slot, strerror(result));
+	}
+
+	spl = splhigh();
+	*entry = paddr | TLBLO_VALID | (*entry & (TLBLO_DIRTY | PTE_COW));
+	bitmap_unmark(swapmap, slot);
+	swapslotsused--;
+	userPageReady(paddr, as, vaddr);
+	splx(spl);
+	swap_pageins++;
+	VMSTAT_INC(as, vs_pagealloc);
+	VMSTAT_INC(as, vs_swapins);
+
+	if (!holding) {
+		lock_release(swaplock);
+	}
+	return 0;
+}
+
+void swap_lock(void) {
+	lock_acquire(swaplock);
+}
+
+void swap_unlock(void) {
+	lock_release(swaplock);
+}
+
+void swap_free(PageTableEntry entry) {
+	int spl = splhigh();
+	assert(PTE_ISSWAPPED(entry));
+	bitmap_unmark(swapmap, PTE_SLOT(entry));
+	swapslotsused--;
+	splx(spl);
+}
+
+void swap_printstats(void) {
+	if (swapvnode == NULL) {
+		kprintf("Swap disabled (no swap disk)\n");
+		return;
+	}
+	kprintf("Swap: %lu/%lu slots used, %lu resident pages evictable\n",
+		(unsigned long)swapslotsused, (unsigned long)swapslots, (unsigned long)residentCount);
+	kprintf("      %lu page-ins, %lu page-outs (%s replacement)\n",
+		swap_pageins, swap_pageouts,
+#if OPT_SWAPFIFO
+		"FIFO"
+#else
+		"clock"
+#endif
+		);
+}
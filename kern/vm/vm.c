@@ -10,6 +10,11 @@
 #include <machine/tlb.h>
 #include <vnode.h>
 #include <elf.h>
+#include <pagetable.h>
+#include <swap.h>
+#include <pagecache.h>
+#include <ksm.h>
+#include <vmalloc.h>
 #include <ourextern.h>
 
 /*
@@ -80,69 +85,363 @@ our_load_segment(struct vnode *v, off_t offset, vaddr_t vaddr,
 //Since even if it's unsigned (since that would be 0xFF....F) which is guaranteed to be out of range
 
 //Search a page table for a specific entry
-inline paddr_t findAddress(PageTable searchList, paddr_t searchKey) {
-	while (searchList != NULL) {
-		if (betweenVals(searchKey, searchList->vaddr, (searchList->vaddr)+PAGE_SIZE)) {
-			return ((searchList->paddr) + searchKey -(searchList->vaddr));
+inline paddr_t findAddress(struct pageTable* searchTable, vaddr_t searchKey) {
+	PageTableEntry* entry = pt_lookup(searchTable, searchKey & PAGE_FRAME);
+	if (entry == NULL || !PTE_PRESENT(*entry)) {
+		return (paddr_t)0;
+	}
+	return PTE_PADDR(*entry) + (searchKey & ~PAGE_FRAME);
+}
+
+//Set the page table entry for VADDR, unless there is one already. Getting the frame can sleep (it can
+//mean paging something out), and meanwhile the page may have been mapped, or mapped and paged out, by
+//someone else; overwriting that would lose its contents. Returns EAGAIN then, and the fault starts over.
+static int mapIfEmpty(struct addrspace* as, vaddr_t vaddr, PageTableEntry newentry) {
+	PageTableEntry* entry;
+	int result;
+	int spl = splhigh();
+
+	entry = pt_lookup(as->pagetable, vaddr);
+	if (entry != NULL && *entry != 0) {
+		result = EAGAIN;
+	}
+	else {
+		//(this may need a new second-level table)
+		result = pt_insert(as->pagetable, vaddr, newentry);
+	}
+	splx(spl);
+	return result;
+}
+
+//Map the new frame PADDR at FAULTADDRESS and charge it to CURRREGION
+static int mapNewPage (struct addrspace* as, Region* currRegion, vaddr_t faultaddress, paddr_t paddr, paddr_t* ret) {
+	int result;
+
+	result = mapIfEmpty(as, faultaddress & PAGE_FRAME, paddr | TLBLO_DIRTY | TLBLO_VALID);
+	if (result) {
+		releasePage(paddr);
+		return result;
+	}
+	currRegion->numPages++;
+	VMSTAT_INC(as, vs_pagealloc);
+
+	paddr += (faultaddress) - (faultaddress & PAGE_FRAME); //now that we have paddr in table we can go to the right offset for return
+	*ret = paddr;
+	return 0;
+}
+
+int createEntry (struct addrspace* as, Region* currRegion, vaddr_t faultaddress, paddr_t* ret) {
+	//Allocate new page (busy until the caller says it is ready)
+	paddr_t paddr = getUserPage();
+	if (paddr == (paddr_t)0) {
+		return ENOMEM;
+	}
+	return mapNewPage(as, currRegion, faultaddress, paddr, ret);
+}
+
+int createAnonEntry (struct addrspace* as, Region* currRegion, vaddr_t faultaddress, paddr_t* ret) {
+	//Heap and stack pages start out as zeros
+	paddr_t paddr = getZeroedPage();
+	if (paddr == (paddr_t)0) {
+		return ENOMEM;
+	}
+	VMSTAT_INC(as, vs_zerofills);
+	return mapNewPage(as, currRegion, faultaddress, paddr, ret);
+}
+
+
+
+
+unsigned long cluster_faults = 0;
+unsigned long cluster_pages = 0;
+
+//Resize the region's fault-around cluster based on whether this fault continues the last one
+//(unless madvise said how the region will be used)
+static int clusterFor(Region* region, vaddr_t faultaddress) {
+	if (region->advice == MADV_RANDOM) {
+		return CLUSTER_MIN;
+	}
+	if (region->advice == MADV_SEQUENTIAL) {
+		return CLUSTER_MAX;
+	}
+	if (region->nextFault == 0) {
+		//First fault in the region, nothing to go on yet
+	}
+	else if (faultaddress == region->nextFault) {
+		if (region->cluster < CLUSTER_MAX) region->cluster *= 2;
+	}
+	else {
+		if (region->cluster > CLUSTER_MIN) region->cluster /= 2;
+	}
+	if (region->cluster < CLUSTER_MIN) region->cluster = CLUSTER_MIN;
+	if (region->cluster > CLUSTER_MAX) region->cluster = CLUSTER_MAX;
+	return region->cluster;
+}
+
+//Bring in the page of a file-backed region at FAULTADDRESS, along with as many of the following pages as
+//the region's cluster size allows, in one read. Whole pages of cached regions (text, private mappings) come
+//from (and are added to) the shared page cache; everything else is read into private pages. The read
+//happens with interrupts on. Returns EAGAIN if the faulting page turned out to be mapped already.
+static int loadFilePage(struct addrspace* as, Region* region, vaddr_t faultaddress, paddr_t* ret) {
+	vaddr_t regionoffset = faultaddress - region->vbase;
+	off_t fileoffset = region->offset + regionoffset;
+	size_t fileleft = (region->filesize > regionoffset) ? region->filesize - regionoffset : 0;
+	int cluster = clusterFor(region, faultaddress);
+	PageTableEntry* entry;
+	paddr_t paddr;
+	vaddr_t vaddr;
+	int npages, result, spl;
+
+	if (region->cached && fileleft >= PAGE_SIZE) {
+		paddr = pagecache_lookup(region->v, fileoffset);
+		if (paddr != (paddr_t)0) {
+			result = mapIfEmpty(as, faultaddress, paddr | TLBLO_VALID | PTE_COW);
+			if (result) {
+				releasePage(paddr);
+				return result;
+			}
+			region->numPages++;
+			region->nextFault = faultaddress + PAGE_SIZE;
+			*ret = paddr;
+			return 0;
+		}
+	}
+
+	//Map the faulting page and the unmapped pages after it, stopping at anything already present
+	npages = 0;
+	for (vaddr = faultaddress; npages < cluster && vaddr < region->vend; vaddr += PAGE_SIZE) {
+		if (npages > 0) {
+			entry = pt_lookup(as->pagetable, vaddr);
+			if (entry != NULL && *entry != 0) {
+				break;
+			}
+		}
+		result = createEntry(as, region, vaddr, &paddr);
+		if (result) {
+			if (npages == 0) {
+				return result;
+			}
+			break;
+		}
+		npages++;
+	}
+	region->nextFault = faultaddress + npages * PAGE_SIZE;
+	cluster_faults++;
+	cluster_pages += npages;
+
+	//The pages are busy, so the pager leaves them alone while the read sleeps
+	result = our_load_segment(region->v, fileoffset, faultaddress, npages * PAGE_SIZE,
+		(fileleft < (size_t)npages * PAGE_SIZE) ? fileleft : (size_t)npages * PAGE_SIZE, region->is_executable);
+
+	spl = splhigh();
+	for (vaddr = faultaddress; vaddr < faultaddress + npages * PAGE_SIZE; vaddr += PAGE_SIZE) {
+		entry = pt_lookup(as->pagetable, vaddr);
+		paddr = PTE_PADDR(*entry);
+		userPageReady(paddr, as, vaddr);
+		if (!result) {
+			VMSTAT_INC(as, vs_fileins);
+		}
+		//(a page the file only partly covers is zero-filled past the end and so depends on the region)
+		if (!result && region->cached && region->filesize >= (vaddr - region->vbase) + PAGE_SIZE &&
+		    pagecache_insert(region->v, region->offset + (vaddr - region->vbase), paddr) == 0) {
+			//Shared from now on, so this mapping loses write access like every other mapping of a cached page
+			*entry = paddr | TLBLO_VALID | PTE_COW;
+			tlb_shootdown(as, vaddr);
+		}
+		else if (!result && (!(region->perms & REGION_WRITE) || region->shared)) {
+			//Writable only while the read filled it in (shared mappings get it back on the first
+			//write, which is how we know what to write back)
+			*entry &= ~TLBLO_DIRTY;
+			tlb_shootdown(as, vaddr);
+		}
+		if (vaddr == faultaddress) {
+			*ret = paddr;
 		}
-		searchList = searchList->next;
 	}
-	return (paddr_t)0;
+	splx(spl);
+	return result;
 }
 
-paddr_t createEntry (Region* currRegion, vaddr_t faultaddress) {
+int vm_prefetch(struct addrspace* as, Region* region, vaddr_t start, vaddr_t end) {
+	PageTableEntry* entry;
 	paddr_t paddr;
-	//Allocate new page
-	paddr = getppages(1);
-	PageTableEntry* newEntry = kmalloc(sizeof(PageTableEntry*));
-	if (newEntry == NULL) {
-		return (paddr_t)0;
+	vaddr_t vaddr = start;
+	int result;
+
+	while (vaddr < end) {
+		entry = pt_lookup(as->pagetable, vaddr);
+		if (entry != NULL && PTE_ISSWAPPED(*entry)) {
+			result = swap_in(as, vaddr, entry);
+			if (result) {
+				return result;
+			}
+		}
+		else if ((entry == NULL || *entry == 0) && region->v != NULL) {
+			//Reads a whole cluster; the pages after this one are present when we get to them
+			result = loadFilePage(as, region, vaddr, &paddr);
+			if (result == EAGAIN) {
+				//Mapped (or paged out) while we were at it; look at it again
+				continue;
+			}
+			if (result) {
+				return result;
+			}
+		}
+		vaddr += PAGE_SIZE;
 	}
-	if (paddr == (paddr_t)0) {
-		kfree(newEntry);
-		return (paddr_t)0;
+	return 0;
+}
+
+void cluster_printstats(void) {
+	kprintf("Fault-around: %lu file reads, %lu pages read", cluster_faults, cluster_pages);
+	if (cluster_faults > 0) {
+		kprintf(" (%lu.%02lu pages per fault)",
+			cluster_pages / cluster_faults, (cluster_pages * 100 / cluster_faults) % 100);
 	}
+	kprintf(", cluster %d-%d pages\n", CLUSTER_MIN, CLUSTER_MAX);
+}
+
+//Frame of zeros mapped read-only for reads of heap and stack nobody has written yet
+paddr_t zeroPage = 0;
+unsigned long zero_pages_mapped = 0;
+unsigned long zero_pages_filled = 0;
+
+//Map the zero page at FAULTADDRESS. The write that eventually comes gets a private page through copyOnWrite.
+static int mapZeroPage(struct addrspace* as, Region* currRegion, vaddr_t faultaddress, paddr_t* ret) {
+	int result;
+	int spl = splhigh();
+
+	result = mapIfEmpty(as, faultaddress & PAGE_FRAME, zeroPage | TLBLO_VALID | PTE_COW);
+	if (result) {
+		splx(spl);
+		return result;
+	}
+	ourcoremap[(zeroPage - firstpaddr)/PAGE_SIZE].state++;
+	splx(spl);
 	currRegion->numPages++;
-	
-	//Set correct values for new entry
-	newEntry->vaddr = faultaddress & PAGE_FRAME;
-	newEntry->paddr = paddr;
-	newEntry->next = NULL;
-	paddr += (faultaddress) - (newEntry->vaddr); //now that we have paddr in table we can go to the right offset for retur
-	
-	//Add new entry to head of linked list while preserving the old head (if it exists)
-	if (currRegion->localPageTable != NULL) {
-		newEntry->next = currRegion->localPageTable;
+	zero_pages_mapped++;
+	*ret = zeroPage;
+	return 0;
+}
+
+//Buddy allocator free lists, one per order (heads are coremap indexes, -1 when empty)
+static int freelists[CM_MAXORDER+1];
+static int freepages = 0;
+
+//Smallest order whose block holds npages
+static int orderFor(unsigned long npages) {
+	int order = 0;
+	while ((1UL << order) < npages) {
+		order++;
 	}
-	currRegion->localPageTable = newEntry;
-	
-	return paddr;
+	return order;
+}
+
+static void pushFree(int index, int order) {
+	ourcoremap[index].order = order;
+	ourcoremap[index].prev = -1;
+	ourcoremap[index].next = freelists[order];
+	if (freelists[order] != -1) {
+		ourcoremap[freelists[order]].prev = index;
+	}
+	freelists[order] = index;
+}
+
+static void removeFree(int index, int order) {
+	if (ourcoremap[index].prev != -1) {
+		ourcoremap[ourcoremap[index].prev].next = ourcoremap[index].next;
+	}
+	else {
+		freelists[order] = ourcoremap[index].next;
+	}
+	if (ourcoremap[index].next != -1) {
+		ourcoremap[ourcoremap[index].next].prev = ourcoremap[index].prev;
+	}
+	ourcoremap[index].next = ourcoremap[index].prev = -1;
 }
 
+//Give a block back, merging it with its buddy for as long as the buddy is free too. Interrupts must be off.
+static void freeBlock(int index) {
+	int order = ourcoremap[index].order;
+	int i;
+	assert(order >= 0);
 
+	for (i = index; i < index + (1 << order); i++) {
+		ourcoremap[i].state = CM_FREE;
+	}
+	freepages += (1 << order);
+	ourcoremap[index].order = -1;
+
+	while (order < CM_MAXORDER) {
+		int buddy = index ^ (1 << order);
+		if (buddy + (1 << order) > totalpages ||
+		    ourcoremap[buddy].state != CM_FREE || ourcoremap[buddy].order != order) {
+			break;
+		}
+		removeFree(buddy, order);
+		ourcoremap[buddy].order = -1;
+		if (buddy < index) index = buddy;
+		order++;
+	}
+	pushFree(index, order);
+}
 
 void vm_bootstrap(void) {
 	//Used to determine endpoint internally and number of pages
 	paddr_t lastaddr;
+	int i, order, cmpages;
 
 	//Getting the first and last addresses
 	ram_getsize(&firstpaddr, &lastaddr);
 
 	//Page align the first address
-	firstpaddr += (firstpaddr%4096);
+	firstpaddr = ROUNDUP(firstpaddr, PAGE_SIZE);
+
+	//The coremap lives at the start of free memory and covers everything after it
+	totalpages = (lastaddr - firstpaddr) / PAGE_SIZE;
+	cmpages = DIVROUNDUP(totalpages * sizeof(Coremap_entry), PAGE_SIZE);
+	ourcoremap = (Coremap_entry*)PADDR_TO_KVADDR(firstpaddr);
+	firstpaddr += cmpages * PAGE_SIZE;
 
 	//Last address is not page aligned but integer division so thats ok
 	totalpages = (lastaddr - firstpaddr) / PAGE_SIZE;
 
 	//Initialize coremap
-	int i = 0;
-	for(; i < totalpages; i++) {
+	for(i = 0; i < totalpages; i++) {
 		//ourcoremap[i].virtualaddr = PADDR_TO_KVADDR(firstpaddr + i*PAGE_SIZE);
 		//ourcoremap[i].timesReferenced = 0;
 		ourcoremap[i].state = CM_FREE;
-		ourcoremap[i].pagesRemaining = 0;
+		ourcoremap[i].order = -1;
+		ourcoremap[i].next = ourcoremap[i].prev = -1;
+		ourcoremap[i].owner = NULL;
+		ourcoremap[i].referenced = 0;
+		ourcoremap[i].busy = 0;
+		ourcoremap[i].unshared = 0;
+	}
+	for (order = 0; order <= CM_MAXORDER; order++) {
+		freelists[order] = -1;
+	}
+
+	//Carve memory into the largest aligned blocks that fit
+	i = 0;
+	while (i < totalpages) {
+		order = CM_MAXORDER;
+		while ((i & ((1 << order) - 1)) != 0 || i + (1 << order) > totalpages) {
+			order--;
+		}
+		pushFree(i, order);
+		freepages += (1 << order);
+		i += (1 << order);
+	}
+
+	//Its one reference is never dropped, so the zero page stays shared (and read-only) forever
+	zeroPage = getppages(1);
+	if (zeroPage == (paddr_t)0) {
+		panic("vm: no memory for the zero page\n");
 	}
+	bzero((void*)PADDR_TO_KVADDR(zeroPage), PAGE_SIZE);
 
+	kprintf("vm: coremap manages %d pages (%d pages of coremap)\n", totalpages, cmpages);
 	return;
 }
 
@@ -156,46 +455,36 @@ paddr_t getppages(unsigned long npages) {
 	//addr = ram_stealmem(npages);
 
 	//OUR Implementation
-	//Look for n consecutive free pages
-	unsigned long consecpages = 0;
-	int found = 0;
-	int i;
-	int start, end;
-	for (i = 0; (i<COREMAP_SIZE) && !found; i++) {
-		if (ourcoremap[i].state == CM_FREE) {
-			consecpages++;
-			if (consecpages == 1) {
-				addr = firstpaddr + i*PAGE_SIZE;
-				start = i;
-			}
-		}
-		else
-			consecpages = 0;
+	//Take the smallest free block that is big enough, splitting it down to the size we want
+	int order = orderFor(npages);
+	int found = order;
+	int index, i;
 
-		 if (consecpages == npages) {
-			found = 1;
-			end = i;
-		}
+	while (found <= CM_MAXORDER && freelists[found] == -1) {
+		found++;
 	}
 
 	//If not found, come back with NULL ptr, otherwise mark pages as used and return 
-	if(!found) {
+	if (found > CM_MAXORDER) {
 		splx(spl); //re-enable interrupts
 		return (paddr_t)0;
 	}
-	else {
-		// ourcoremap[i-npages+1].pagesRemaining = npages;
-		// npages = i - npages;
-		// while (i > npages) {
-		// 	ourcoremap[i--].state = CM_USED;
-		// }
-		int i;
-		for(i = start; i <= end; i++) {
-			ourcoremap[i].state++;
-			ourcoremap[i].pagesRemaining = npages--;
-		}
 
+	index = freelists[found];
+	removeFree(index, found);
+	while (found > order) {
+		found--;
+		pushFree(index + (1 << found), found);
 	}
+
+	ourcoremap[index].order = order;
+	for (i = index; i < index + (1 << order); i++) {
+		assert(ourcoremap[i].state == CM_FREE);
+		ourcoremap[i].state++;
+	}
+	freepages -= (1 << order);
+
+	addr = firstpaddr + index*PAGE_SIZE;
 	splx(spl);
 	return addr;
 }
@@ -223,42 +512,423 @@ void free_kpages(vaddr_t addr) {
 	//Get to the physical address from the virtual address
 	paddr_t phys = KVADDR_TO_PADDR(addr);
 
-	//Get the right index and endpoint in the array
+	//Get the right index in the array; it must be the start of a block
 	int i = (phys - firstpaddr)/PAGE_SIZE;
+	assert(i >= 0 && i < totalpages);
+	assert(ourcoremap[i].order >= 0 && ourcoremap[i].state > CM_FREE);
 
-	//int endpoint = (i+ourcoremap[i].pagesRemaining);
-	//Free the memory in the coremap
-	// ourcoremap[i].pagesRemaining = 0;
-	// for (; i< endpoint; i++) {
-	// 	ourcoremap[i].state = CM_FREE;
-	// 	ourcoremap[i].pagesRemaining = 0;
+	freeBlock(i);
 
-	// }
+	splx(spl);
+	return;
+}
 
-	while (ourcoremap[i].pagesRemaining > 0) {
-		ourcoremap[i].state--;
-		if (ourcoremap[i].pagesRemaining == 1) {
-			ourcoremap[i].pagesRemaining = 0;
-			break;
+unsigned long cow_pages_shared = 0;
+unsigned long cow_pages_copied = 0;
+
+//Another page table maps this user page now (fork shares pages instead of copying them)
+void sharePage(paddr_t paddr) {
+	int spl = splhigh();
+	int cmIndex = (paddr - firstpaddr)/PAGE_SIZE;
+	assert(ourcoremap[cmIndex].state > CM_FREE);
+	//A shared page has no single owner to fix up, so it stays resident until it is unshared
+	swap_untrack(paddr);
+	ourcoremap[cmIndex].state++;
+	cow_pages_shared++;
+	splx(spl);
+}
+
+//Drop one reference to a user page (the page goes back to the allocator once its state gets back to CM_FREE)
+void releasePage(paddr_t paddr) {
+	int spl = splhigh();
+	int cmIndex = (paddr - firstpaddr)/PAGE_SIZE;
+	assert(ourcoremap[cmIndex].state > CM_FREE);
+	assert(ourcoremap[cmIndex].order == 0);
+	ourcoremap[cmIndex].state--; //state-- rather than CM_FREE
+	if (ourcoremap[cmIndex].state == CM_FREE) {
+		swap_untrack(paddr);
+		ksm_forget(paddr);
+		ourcoremap[cmIndex].busy = 0;
+		freeBlock(cmIndex);
+	}
+	else if (ourcoremap[cmIndex].state == 1 && paddr != zeroPage) {
+		//Whoever still maps it can have it paged out again
+		swap_unshared(paddr);
+	}
+	splx(spl);
+}
+
+//TLB refill. Slots are handed out round-robin, so once the TLB is full every refill replaces
+//the entry that has been in the longest (which is how programs bigger than 64 pages keep running).
+static int tlbNext = 0;
+
+//User entries carry the ASID of their address space, so switching address spaces only changes
+//which entries match. IDs are handed out per generation; when all NUM_ASID are taken the TLB is
+//flushed, a new generation starts and everyone gets a fresh ID the next time they are activated.
+static unsigned int asidGeneration = 1;
+static int asidInUse[NUM_ASID];
+static int asidFree = NUM_ASID;
+static int curasid = 0;
+
+//Page table the UTLB vector in exception.S walks to refill without a trip through vm_fault
+//(NULL sends every miss to vm_fault)
+struct pageTable* curpagetable = NULL;
+int utlb_fastpath = 1;
+
+unsigned long tlb_misses = 0;
+unsigned long tlb_fastrefills = 0;
+unsigned long tlb_evictions = 0;
+unsigned long tlb_shootdowns = 0;
+unsigned long tlb_rollovers = 0;
+
+static int asidLive(struct addrspace* as) {
+	return as != NULL && as->asidGeneration == asidGeneration;
+}
+
+//Load a translation for VADDR in the current address space, replacing the one already there if the TLB has it
+void tlb_load(vaddr_t vaddr, u_int32_t elo) {
+	int spl = splhigh();
+	u_int32_t ehi = (vaddr & TLBHI_VPAGE) | (curasid << TLBHI_PIDSHIFT);
+	u_int32_t oldhi, oldlo;
+	int index;
+
+	index = TLB_Probe(ehi, 0);
+	if (index < 0) {
+		index = tlbNext;
+		tlbNext = (tlbNext + 1) % NUM_TLB;
+		TLB_Read(&oldhi, &oldlo, index);
+		if (oldlo & TLBLO_VALID) {
+			tlb_evictions++;
 		}
-		ourcoremap[i].pagesRemaining = 0;
-		i++;
 	}
+	TLB_Write(ehi, elo, index);
+	splx(spl);
+}
+
+//Invalidate the translation for one page of AS (nothing to do if AS has no entries in the TLB).
+//AS NULL means a global kernel translation, which matches whatever ASID we probe with.
+void tlb_shootdown(struct addrspace* as, vaddr_t vaddr) {
+	int spl = splhigh();
+	int index;
 
+	if (as == NULL || asidLive(as)) {
+		index = TLB_Probe((vaddr & TLBHI_VPAGE) | ((as == NULL ? curasid : as->asid) << TLBHI_PIDSHIFT), 0);
+		if (index >= 0) {
+			TLB_Write(TLBHI_INVALID(index), TLBLO_INVALID(), index);
+			tlb_shootdowns++;
+		}
+		TLB_SetPID(curasid);
+	}
 	splx(spl);
-	return;
+}
+
+//Invalidate every entry
+void tlb_flush(void) {
+	int i, spl;
+
+	spl = splhigh();
+	//NUM_TLB is defined as 64 elsewhere
+	for (i=0; i<NUM_TLB; i++) {
+		TLB_Write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	tlbNext = 0;
+	TLB_SetPID(curasid);
+	splx(spl);
+}
+
+//Invalidate every entry belonging to AS
+void tlb_flush_as(struct addrspace* as) {
+	u_int32_t ehi, elo;
+	int i, spl;
+
+	spl = splhigh();
+	if (asidLive(as)) {
+		for (i=0; i<NUM_TLB; i++) {
+			TLB_Read(&ehi, &elo, i);
+			if ((elo & TLBLO_VALID) && ((ehi & TLBHI_PID) >> TLBHI_PIDSHIFT) == (u_int32_t)as->asid) {
+				TLB_Write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+			}
+		}
+		TLB_SetPID(curasid);
+	}
+	splx(spl);
+}
+
+//Make AS the one the TLB matches against, giving it an ASID first if it does not have a live one
+void tlb_activate(struct addrspace* as) {
+	int i, spl;
+
+	spl = splhigh();
+	if (!asidLive(as)) {
+		if (asidFree == 0) {
+			//Out of IDs: nothing tagged with an old one can be trusted any more
+			asidGeneration++;
+			for (i=0; i<NUM_ASID; i++) {
+				asidInUse[i] = 0;
+			}
+			asidFree = NUM_ASID;
+			tlb_rollovers++;
+			tlb_flush();
+		}
+		for (i=0; asidInUse[i]; i++);
+		asidInUse[i] = 1;
+		asidFree--;
+		as->asid = i;
+		as->asidGeneration = asidGeneration;
+	}
+	curasid = as->asid;
+	curpagetable = utlb_fastpath ? as->pagetable : NULL;
+	TLB_SetPID(curasid);
+	splx(spl);
+}
+
+//AS is going away: drop its entries and give its ASID back
+void tlb_release(struct addrspace* as) {
+	int spl = splhigh();
+
+	if (asidLive(as)) {
+		tlb_flush_as(as);
+		asidInUse[as->asid] = 0;
+		asidFree++;
+		as->asidGeneration = 0;
+	}
+	//Its page table is about to be freed
+	if (curpagetable == as->pagetable) {
+		curpagetable = NULL;
+	}
+	splx(spl);
+}
+
+void tlb_printstats(void) {
+	kprintf("TLB: %lu misses refilled in the exception vector, %lu through vm_fault (fast path %s)\n",
+		tlb_fastrefills, tlb_misses, utlb_fastpath ? "on" : "off");
+	kprintf("     %lu evictions, %lu single-page shootdowns\n", tlb_evictions, tlb_shootdowns);
+	kprintf("     %d/%d ASIDs in use, generation %u (%lu rollovers)\n",
+		NUM_ASID - asidFree, NUM_ASID, asidGeneration, tlb_rollovers);
+}
+
+//Where physical memory is going. Frames mapped by more than one page table (fork, the page cache, the zero
+//page) are counted once under shared.
+//Frames the idle loop has zeroed, ready for anonymous faults
+static paddr_t zeroPool[ZEROPOOL_HIGH];
+static int zeroPoolCount = 0;
+unsigned long zeropool_hits = 0;
+unsigned long zeropool_misses = 0;
+
+struct vmstats vm_globalstats;
+
+void vm_printstats(const struct vmstats* stats) {
+	kprintf("TLB faults: %lu read, %lu write, %lu read-only\n",
+		(unsigned long)stats->vs_faults_read, (unsigned long)stats->vs_faults_write,
+		(unsigned long)stats->vs_faults_readonly);
+	kprintf("Pages:      %lu allocated, %lu freed, %lu zero-filled\n",
+		(unsigned long)stats->vs_pagealloc, (unsigned long)stats->vs_pagefree,
+		(unsigned long)stats->vs_zerofills);
+	kprintf("Paging:     %lu read from files, %lu swapped in, %lu swapped out\n",
+		(unsigned long)stats->vs_fileins, (unsigned long)stats->vs_swapins,
+		(unsigned long)stats->vs_swapouts);
+	kprintf("Fork:       %lu pages shared, %lu copied on write\n",
+		(unsigned long)stats->vs_forkshared, (unsigned long)stats->vs_cowcopies);
+}
+
+void vm_printmemstats(void) {
+	int spl = splhigh();
+	int i, nfree = 0, private = 0, shared = 0, other = 0, zeromaps;
+
+	for (i = 0; i < totalpages; i++) {
+		if (ourcoremap[i].state == CM_FREE) nfree++;
+		else if (ourcoremap[i].owner != NULL) private++;
+		else if (ourcoremap[i].state > 1) shared++;
+		else other++;
+	}
+	zeromaps = ourcoremap[(zeroPage - firstpaddr)/PAGE_SIZE].state - 1;
+	splx(spl);
+
+	kprintf("Memory: %d pages, %d free\n", totalpages, nfree);
+	kprintf("        %d private user pages, %d shared pages, %d kernel/cached pages\n", private, shared, other);
+	kprintf("        zero page mapped %d times now (%lu reads served, %lu later written)\n",
+		zeromaps, zero_pages_mapped, zero_pages_filled);
+	kprintf("        %d/%d pre-zeroed pages ready, %lu hits, %lu misses\n",
+		zeroPoolCount, ZEROPOOL_HIGH, zeropool_hits, zeropool_misses);
+}
+
+static paddr_t zeroPoolTake(void) {
+	int spl = splhigh();
+	paddr_t paddr = (paddr_t)0;
+
+	if (zeroPoolCount > 0) {
+		paddr = zeroPool[--zeroPoolCount];
+	}
+	splx(spl);
+	return paddr;
+}
+
+int vm_idle(void) {
+	paddr_t paddr;
+
+	assert(curspl > 0);
+	//Not booted yet
+	if (zeroPage == (paddr_t)0) {
+		return 0;
+	}
+	//Pool full, or memory too tight to hold frames back from everyone else: look for pages to merge instead
+	if (zeroPoolCount >= ZEROPOOL_HIGH || freepages <= 2 * SWAP_LOWWATER) {
+		return ksm_scan();
+	}
+	paddr = getppages(1);
+	if (paddr == (paddr_t)0) {
+		return ksm_scan();
+	}
+	bzero((void*)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+	zeroPool[zeroPoolCount++] = paddr;
+	return 1;
+}
+
+paddr_t getZeroedPage(void) {
+	paddr_t paddr = zeroPoolTake();
+
+	if (paddr != (paddr_t)0) {
+		zeropool_hits++;
+		ourcoremap[(paddr - firstpaddr)/PAGE_SIZE].busy = 1;
+		return paddr;
+	}
+	zeropool_misses++;
+	paddr = getUserPage();
+	if (paddr != (paddr_t)0) {
+		bzero((void*)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+	}
+	return paddr;
+}
+
+//Allocate a frame for a user page. Once free memory gets down to the low-water mark a resident user
+//page is paged out for every one allocated, so kernel allocations never find memory exhausted by users.
+paddr_t getUserPage(void) {
+	paddr_t paddr;
+
+	if (freepages <= SWAP_LOWWATER) {
+		swap_evict();
+	}
+	paddr = getppages(1);
+	//Pre-zeroed frames, cached executable pages nobody maps, spare thread stacks and empty kernel
+	//object slabs are the cheapest things to give up, then resident user pages
+	if (paddr == (paddr_t)0) {
+		paddr = zeroPoolTake();
+	}
+	if (paddr == (paddr_t)0 && pagecache_shrink() > 0) {
+		paddr = getppages(1);
+	}
+	if (paddr == (paddr_t)0 && thread_shrink() > 0) {
+		paddr = getppages(1);
+	}
+	if (paddr == (paddr_t)0 && kcache_reap() > 0) {
+		paddr = getppages(1);
+	}
+	if (paddr == (paddr_t)0 && swap_evict() == 0) {
+		paddr = getppages(1);
+	}
+	if (paddr != (paddr_t)0) {
+		ourcoremap[(paddr - firstpaddr)/PAGE_SIZE].busy = 1;
+	}
+	return paddr;
+}
+
+//A user page from getUserPage is filled in and mapped at VADDR in AS: it can be paged out from now on
+//(unless something else maps it too)
+void userPageReady(paddr_t paddr, struct addrspace* as, vaddr_t vaddr) {
+	int spl = splhigh();
+	int cmIndex = (paddr - firstpaddr)/PAGE_SIZE;
+
+	assert(ourcoremap[cmIndex].busy);
+	ourcoremap[cmIndex].busy = 0;
+	if (ourcoremap[cmIndex].state == 1) {
+		swap_track(paddr, as, vaddr);
+	}
+	splx(spl);
+}
+
+//First write to a page of a shared file mapping: let it through and remember the page has changed
+static int markDirty(struct addrspace* as, vaddr_t faultaddress) {
+	PageTableEntry* entry;
+	int spl = splhigh();
+
+	entry = pt_lookup(as->pagetable, faultaddress);
+	if (entry != NULL && PTE_PRESENT(*entry)) {
+		*entry = (*entry | TLBLO_DIRTY) & ~PTE_UNREF;
+		ourcoremap[(PTE_PADDR(*entry) - firstpaddr)/PAGE_SIZE].referenced = 1;
+		tlb_load(faultaddress, *entry & PTE_TLBBITS);
+	}
+	//Otherwise it was paged out in the meantime; the retried write faults it back in
+	splx(spl);
+	return 0;
+}
+
+//Handle a write to a page that fork left read-only. If someone else still maps the frame the writer
+//gets a private copy, otherwise it just gets write access back. The copy is made with interrupts on;
+//our reference keeps the old frame around meanwhile, and shared frames are never paged out.
+static int copyOnWrite(struct addrspace* as, vaddr_t faultaddress) {
+	PageTableEntry* entry;
+	paddr_t paddr, newpaddr;
+	int spl;
+
+	spl = splhigh();
+	entry = pt_lookup(as->pagetable, faultaddress);
+	if (entry == NULL || !PTE_PRESENT(*entry) || !(*entry & PTE_COW)) {
+		splx(spl);
+		return EFAULT;
+	}
+
+	paddr = PTE_PADDR(*entry);
+	if (*entry & PTE_MERGED) {
+		ksm_pages_unmerged++;
+	}
+	if (ourcoremap[(paddr - firstpaddr)/PAGE_SIZE].state == 1) {
+		//Last one left mapping it, so it can be paged out again (and written, so it can no longer be merged with)
+		ksm_forget(paddr);
+		swap_track(paddr, as, faultaddress);
+	}
+	else {
+		splx(spl);
+		newpaddr = (paddr == zeroPage) ? getZeroedPage() : getUserPage();
+		if (newpaddr == (paddr_t)0) {
+			return ENOMEM;
+		}
+		VMSTAT_INC(as, vs_pagealloc);
+		if (paddr == zeroPage) {
+			zero_pages_filled++;
+			VMSTAT_INC(as, vs_zerofills);
+		}
+		else {
+			memmove((void*)PADDR_TO_KVADDR(newpaddr), (const void*)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+			cow_pages_copied++;
+			VMSTAT_INC(as, vs_cowcopies);
+		}
+		spl = splhigh();
+		releasePage(paddr);
+		paddr = newpaddr;
+		userPageReady(paddr, as, faultaddress);
+	}
+	*entry = paddr | TLBLO_DIRTY | TLBLO_VALID;
+
+	//The read-only translation is still in the TLB (that is why we faulted), so this replaces it in place
+	tlb_load(faultaddress, *entry & PTE_TLBBITS);
+	splx(spl);
+	return 0;
 }
 
 int vm_fault(int faulttype, vaddr_t faultaddress) {
 	//vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
 	paddr_t paddr;
-	int i;
-	u_int32_t ehi, elo;
+	u_int32_t elo;
 	int readFault = 0;
 	struct addrspace *as;
 
-	int spl;
-	spl = splhigh();
+	PageTableEntry* entry;
+	Region* region;
+	int spl, result;
+
+	//Interrupts stay on while we find or fill the page (that can mean disk I/O); only the final
+	//page table check and TLB load are done with them off. The page's state can change while we
+	//sleep, so it is looked at again when the new mapping goes in; if it changed we start over here.
 
 
 	//kprintf("\n\nbefore: %x\n\n", faultaddress);
@@ -270,21 +940,28 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		/* We always create pages read-write, so we can't get this */
+		/* Pages shared by fork are mapped read-only until written */
 		//panic("dumbvm: got VM_FAULT_READONLY\n");
+		break;
 		case VM_FAULT_READ:
 			readFault = 1;
+			tlb_misses++;
 			break;
 		case VM_FAULT_WRITE:
 			//readFault = 1;
+			tlb_misses++;
 			break;
 		break;
 	    default:
-		splx(spl);
 		kprintf("-1\n\n");
 		return EINVAL;
 	}
 
+	//Kernel memory from vmalloc, whoever's address space is current
+	if (faultaddress >= MIPS_KSEG2) {
+		return vmalloc_fault(faultaddress);
+	}
+
 	as = curthread->t_vmspace;
 	if (as == NULL) {
 		/*
@@ -296,6 +973,39 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
 		return EFAULT;
 	}
 
+	if (faulttype == VM_FAULT_READ) {
+		VMSTAT_INC(as, vs_faults_read);
+	}
+	else if (faulttype == VM_FAULT_WRITE) {
+		VMSTAT_INC(as, vs_faults_write);
+	}
+	else {
+		VMSTAT_INC(as, vs_faults_readonly);
+	}
+
+	//Writes to pages shared by fork land here; give the writer its own copy
+	//(unless the region is read-only, in which case the write was never allowed)
+	if (faulttype == VM_FAULT_READONLY) {
+		region = as_findregion(as, faultaddress);
+		if (region != NULL && !(region->perms & REGION_WRITE)) {
+			return EFAULT;
+		}
+		if (region != NULL && region->shared) {
+			return markDirty(as, faultaddress);
+		}
+		return copyOnWrite(as, faultaddress);
+	}
+
+	//Pages that were paged out come back from the swap disk, whatever region they are in
+retry:
+	entry = pt_lookup(as->pagetable, faultaddress);
+	if (entry != NULL && PTE_ISSWAPPED(*entry)) {
+		result = swap_in(as, faultaddress, entry);
+		if (result) {
+			return result;
+		}
+	}
+
 	/* Assert that the address space has been set up properly. */
 	//TODO: Make new versions of these asserts
 	// //commenting out their code but not deleting it
@@ -338,110 +1048,78 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
 	//OUR Version
 	// kprintf("%x\n\n", faultaddress);
 	//assert(0);
-	if (betweenVals(faultaddress, (as->region1).vbase, (as->region1).vend)) {
+	//Text, data and other file-backed segments (binary search of the region table)
+	region = as_findregion(as, faultaddress);
+	if (region != NULL) {
 		//Search page table to find physical address if exists
-		paddr = findAddress((as->region1).localPageTable, faultaddress);
+		paddr = findAddress(as->pagetable, faultaddress);
 
-		//Handle if address is not found
-		if (paddr == (paddr_t)0) {
-			//If page does not exist, we still have a valid address -> create one and put it in the page table
-			paddr = createEntry(&(as->region1), faultaddress);
-			if (paddr == (paddr_t)0) {
-				splx(spl);
-				return EFAULT;
-			}
-			//if(readFault) kprintf("trying to read to region1??\n");
-			if(1) {
-				int result = our_load_segment(as->v, (as->region1).offset + faultaddress - (as->region1).vbase, 
-				faultaddress, PAGE_SIZE, (as->region1).filesize - (faultaddress - (as->region1).vbase), (as->region1).is_executable);
-				//if(result) return result; 
-				// (as->region1).filesize -= PAGE_SIZE;
-				// if((as->region1).filesize < 0) {
-				// 	kprintf("resetting");
-				// 	(as->region1).filesize = 0;
-				// }
-				//kprintf("did the load segment, returning\n");
-				splx(spl);
-				return 0;
-			}
-		}
-		//kprintf("did NOT the load segment\n");
-	}
-	else if (betweenVals(faultaddress, (as->region2).vbase, (as->region2).vend)) {
-		//Search page table to find physical address if exists
-		paddr = findAddress((as->region2).localPageTable, faultaddress);
-		
-		//Handle if address is not found
+		//If page does not exist, we still have a valid address -> bring it in from the file
 		if (paddr == (paddr_t)0) {
-			//If page does not exist, we still have a valid address -> create one and put it in the page table
-			paddr = createEntry(&(as->region2), faultaddress);
-			if (paddr == (paddr_t)0) {
-				splx(spl);
-				return EFAULT;
+			result = loadFilePage(as, region, faultaddress, &paddr);
+			if (result == EAGAIN) {
+				goto retry;
 			}
-				//if(readFault) kprintf("trying to read to region2??\n");
-				if(1) {
-					int result = our_load_segment(as->v, (as->region2).offset + faultaddress - (as->region2).vbase, 
-				faultaddress, PAGE_SIZE, (as->region2).filesize - (faultaddress - (as->region2).vbase), (as->region2).is_executable);
-				//if(result) return result; 
-				// (as->region2).filesize -= PAGE_SIZE;
-				// if((as->region2).filesize < 0) {
-				// 	kprintf("resetting");
-				// 	(as->region2).filesize = 0;
-				// }
-				//kprintf("did the load segment, returning\n");
-				splx(spl);
-				return 0;
+			if (result) {
+				return result;
 			}
 		}
-
-		//kprintf("did NOT the load segment\n");
-		
 	}
 	else if (betweenVals(faultaddress, (as->heap).vbase, (as->heap).vend)) {
 		//Search page table to find physical address if exists
-		paddr = findAddress((as->heap).localPageTable, faultaddress);
+		paddr = findAddress(as->pagetable, faultaddress);
 
 		//We let the heap grow to the heap limit because of the demands of one of the tests (btree)
 		//However, artificially limit its size to contain only a set number of physical pages to pass a different test (malloctest)
-		if ((as->heap).numPages >= HEAPPHYSICALLIMIT) {
-			splx(spl);
+		//(only without swap; with a swap disk the heap can be as big as its virtual limit)
+		if (paddr == (paddr_t)0 && !swap_enabled() && (as->heap).numPages >= HEAPPHYSICALLIMIT) {
 			kprintf("Failed in heap.\n");
 			return EFAULT;
 		}
 		
 		//If page does not exist, we still have a valid address -> create one and put it in the page table
+		//(reads of memory nobody has written yet just see the zero page until the first write)
 		if (paddr == (paddr_t)0) {
-			paddr = createEntry(&(as->heap), faultaddress);
-			if (paddr == (paddr_t)0) {
-				splx(spl);
+			result = readFault ? mapZeroPage(as, &(as->heap), faultaddress, &paddr) : createAnonEntry(as, &(as->heap), faultaddress, &paddr);
+			if (result == EAGAIN) {
+				goto retry;
+			}
+			if (result) {
 				kprintf("Failed in heap.\n");
 				return EFAULT;
 			}
+			if (!readFault) {
+				userPageReady(paddr, as, faultaddress);
+			}
 		}
 	}
 	else if (betweenVals(faultaddress, (USERSTACK - STACKLIMIT)/*(((as->stack).vbase) - PAGE_SIZE)*/, (as->stack).vend)) {
 		//Search page table to find physical address if exists
-		paddr = findAddress((as->stack).localPageTable, faultaddress);
+		paddr = findAddress(as->pagetable, faultaddress);
 
 		//TODO: Passing btree with long stack makes us fail crash. Fix it...
 		
 		//We let the stack grow to the stack limit because of the demands of one of the tests (btree)
 		//However, artificially limit its size to contain only a set number of physical pages to pass a different test (malloctest)
-		if ((as->stack).numPages >= STACKPHYSICALLIMIT) {
-			splx(spl);
+		if (paddr == (paddr_t)0 && !swap_enabled() && (as->stack).numPages >= STACKPHYSICALLIMIT) {
 			kprintf("Failed in stack.\n");
 			return EFAULT;
 		}
 
 		//If page does not exist, we still have a valid address -> create one and put it in the page table
+		//(reads of memory nobody has written yet just see the zero page until the first write)
 		if (paddr == (paddr_t)0) {
-			paddr = createEntry(&(as->stack), faultaddress);
-			if (paddr == (paddr_t)0) {
-				splx(spl);
+			result = readFault ? mapZeroPage(as, &(as->stack), faultaddress, &paddr) : createAnonEntry(as, &(as->stack), faultaddress, &paddr);
+			if (result == EAGAIN) {
+				goto retry;
+			}
+			if (result) {
 				kprintf("Failed in stack.\n");
 				return EFAULT;
 			}
+			if (!readFault) {
+				userPageReady(paddr, as, faultaddress);
+			}
 		}
 		
 		//It has to exist (static stack for now)
@@ -474,7 +1152,6 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
 		// }
 	}
 	else {
-		splx(spl);
 		vaddr_t asd = (as->stack).vbase - STACKLIMIT;
 		vaddr_t asdf = USERSTACK;
 		//kprintf("%x", (USERSTACK - faultaddress));
@@ -483,23 +1160,24 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
 		return EFAULT;
 	}
 	// kprintf("out of that if stuff\n");
-	/* make sure it's page-aligned */
-	assert((paddr & PAGE_FRAME)==paddr);
-//kprintf("boutta do tlb stuff\n");
-	for (i=0; i<NUM_TLB; i++) {
-		TLB_Read(&ehi, &elo, i);
-		if (elo & TLBLO_VALID) {
-			continue;
-		}
-		ehi = faultaddress;
-		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
-		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
-		TLB_Write(ehi, elo, i);
+	//Load the translation the page table has now. If the page was paged out again while we were
+	//getting it in, the access just faults again.
+	spl = splhigh();
+	entry = pt_lookup(as->pagetable, faultaddress);
+	if (entry == NULL || !PTE_PRESENT(*entry)) {
 		splx(spl);
 		return 0;
 	}
-
-	kprintf("dumbvm: Ran out of TLB entries - cannot handle page fault\n");
+	paddr = PTE_PADDR(*entry);
+	/* make sure it's page-aligned */
+	assert((paddr & PAGE_FRAME)==paddr);
+	//Load the entry as the page table has it (pages shared by fork stay read-only)
+	elo = *entry & PTE_TLBBITS;
+	//Tell the clock hand this page is in use (and let the fast refill have it again)
+	ourcoremap[(paddr - firstpaddr)/PAGE_SIZE].referenced = 1;
+	*entry &= ~PTE_UNREF;
+	DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
+	tlb_load(faultaddress, elo);
 	splx(spl);
-	return EFAULT;
+	return 0;
 }
@@ -0,0 +1,162 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <vm.h>
+#include <pagetable.h>
+#include <vmalloc.h>
+#include <machine/spl.h>
+#include <machine/tlb.h>
+
+/*
+ * kseg2 kernel allocator. See vmalloc.h.
+ */
+
+//One allocated range of kseg2 (its guard page follows it)
+typedef struct vmArea {
+	vaddr_t start;
+	int npages;
+	struct vmArea* next;
+} VmArea;
+
+//Areas in address order
+static VmArea* areas = NULL;
+static struct kcache* areacache = NULL;
+
+//Translations for kseg2, indexed by offset from VMALLOC_BASE
+static PageTable* kernpt = NULL;
+
+static int vm_areas = 0;
+static int vm_pages = 0;
+static unsigned long vm_allocs = 0;
+static unsigned long vm_failures = 0;
+
+//Unmap and free the first NPAGES pages at START. Interrupts must be off.
+static void unmapPages(vaddr_t start, int npages) {
+	PageTableEntry old;
+	vaddr_t vaddr;
+	int i;
+
+	for (i = 0; i < npages; i++) {
+		vaddr = start + i * PAGE_SIZE;
+		old = pt_remove(kernpt, vaddr - VMALLOC_BASE);
+		if (PTE_PRESENT(old)) {
+			//Global entries match any address space, so one shootdown covers everyone
+			tlb_shootdown(NULL, vaddr);
+			free_kpages(PADDR_TO_KVADDR(PTE_PADDR(old)));
+			vm_pages--;
+		}
+	}
+}
+
+void* vmalloc(size_t size) {
+	int npages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+	VmArea **prev, *area;
+	vaddr_t start, kva;
+	int i, spl;
+
+	if (npages == 0 || npages >= VMALLOC_PAGES) {
+		return NULL;
+	}
+
+	spl = splhigh();
+	if (kernpt == NULL) {
+		areacache = kcache_create("vmarea", sizeof(VmArea), NULL);
+		kernpt = pt_create();
+		if (areacache == NULL || kernpt == NULL) {
+			panic("vmalloc: cannot set up the kernel page table\n");
+		}
+	}
+
+	//First fit: the lowest gap big enough for the area and its guard page
+	start = VMALLOC_BASE;
+	for (prev = &areas; *prev != NULL; prev = &(*prev)->next) {
+		if ((*prev)->start - start >= (vaddr_t)(npages + 1) * PAGE_SIZE) {
+			break;
+		}
+		start = (*prev)->start + ((*prev)->npages + 1) * PAGE_SIZE;
+	}
+	if (start + (npages + 1) * PAGE_SIZE > VMALLOC_BASE + VMALLOC_PAGES * PAGE_SIZE) {
+		vm_failures++;
+		splx(spl);
+		return NULL;
+	}
+
+	area = kcache_alloc(areacache);
+	if (area == NULL) {
+		vm_failures++;
+		splx(spl);
+		return NULL;
+	}
+
+	//Any frames will do, one at a time
+	for (i = 0; i < npages; i++) {
+		kva = alloc_kpages(1);
+		if (kva == 0 || pt_insert(kernpt, start + i * PAGE_SIZE - VMALLOC_BASE,
+		    KVADDR_TO_PADDR(kva) | TLBLO_VALID | TLBLO_DIRTY | TLBLO_GLOBAL)) {
+			if (kva != 0) {
+				free_kpages(kva);
+			}
+			unmapPages(start, i);
+			kcache_free(areacache, area);
+			vm_failures++;
+			splx(spl);
+			return NULL;
+		}
+		vm_pages++;
+	}
+
+	area->start = start;
+	area->npages = npages;
+	area->next = *prev;
+	*prev = area;
+	vm_areas++;
+	vm_allocs++;
+	splx(spl);
+
+	return (void*)start;
+}
+
+void vfree(void* ptr) {
+	VmArea **prev, *area;
+	int spl = splhigh();
+
+	for (prev = &areas; *prev != NULL; prev = &(*prev)->next) {
+		if ((*prev)->start == (vaddr_t)ptr) {
+			break;
+		}
+	}
+	if (*prev == NULL) {
+		panic("vfree: %p was not allocated with vmalloc\n", ptr);
+	}
+
+	area = *prev;
+	*prev = area->next;
+	unmapPages(area->start, area->npages);
+	kcache_free(areacache, area);
+	vm_areas--;
+	splx(spl);
+}
+
+int vmalloc_fault(vaddr_t vaddr) {
+	PageTableEntry* entry;
+	int spl = splhigh();
+
+	if (kernpt == NULL || vaddr >= VMALLOC_BASE + VMALLOC_PAGES * PAGE_SIZE) {
+		splx(spl);
+		return EFAULT;
+	}
+	entry = pt_lookup(kernpt, (vaddr & PAGE_FRAME) - VMALLOC_BASE);
+	if (entry == NULL || !PTE_PRESENT(*entry)) {
+		//Unmapped, a guard page or freed: a kernel bug
+		splx(spl);
+		return EFAULT;
+	}
+	tlb_load(vaddr & PAGE_FRAME, *entry & PTE_TLBBITS);
+	splx(spl);
+	return 0;
+}
+
+void vmalloc_printstats(void) {
+	kprintf("vmalloc: %d areas, %d pages mapped in kseg2 (%lu allocations, %lu failed)\n",
+		vm_areas, vm_pages, vm_allocs, vm_failures);
+}
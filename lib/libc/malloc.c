@@ -7,6 +7,11 @@
  * easy to follow. It performs abysmally if the heap becomes larger than
  * physical memory. To get (much) better out-of-core performance, port
  * the kernel's malloc. :-)
+ *
+ * Whole pages inside a free block are handed back to the kernel with
+ * madvise(MADV_DONTNEED), so memory freed in the middle of the heap
+ * stops using frames even though the break cannot move down past the
+ * blocks still in use above it.
  */
 
 #include <stdlib.h>
@@ -14,10 +19,19 @@
 #include <err.h>
 #ifdef HOST
 #include <stdint.h>  // for uintptr_t on non-OS/161 platforms
+#else
+#include <sys/mman.h>
 #endif
 
 #undef MALLOCDEBUG
 
+/*
+ * Free blocks with at least MRELEASEMIN bytes of whole pages inside
+ * give those pages back to the kernel. MPAGESIZE is the VM page size.
+ */
+#define MPAGESIZE   4096
+#define MRELEASEMIN MPAGESIZE
+
 #if defined(__mips__) || defined(__i386__)
 #define MALLOC32
 #elif defined(__alpha__)
@@ -450,6 +464,45 @@ __malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
 	__malloc_deadbeef(mhnext, sizeof(struct mheader));
 }
 
+/*
+ * Find the whole pages inside the data area of free block mh that
+ * overlap [data, dataend), the part that was just freed, if there are
+ * enough of them to be worth giving back. (Pages wholly in the rest of
+ * the block went back when that part was freed.) Sets *start and *end
+ * to the page-aligned range, or both to 0.
+ */
+static
+void
+__malloc_releaserange(struct mheader *mh, uintptr_t data, uintptr_t dataend,
+		      uintptr_t *start, uintptr_t *end)
+{
+#ifdef HOST
+	/* Nothing to give memory back with */
+	(void)mh;
+	(void)data;
+	(void)dataend;
+	*start = *end = 0;
+#else
+	uintptr_t lo, hi;
+
+	*start = ((uintptr_t)M_DATA(mh) + MPAGESIZE - 1) & ~(uintptr_t)(MPAGESIZE-1);
+	*end = (uintptr_t)M_NEXT(mh) & ~(uintptr_t)(MPAGESIZE-1);
+
+	lo = data & ~(uintptr_t)(MPAGESIZE-1);
+	hi = (dataend + MPAGESIZE - 1) & ~(uintptr_t)(MPAGESIZE-1);
+	if (*start < lo) {
+		*start = lo;
+	}
+	if (*end > hi) {
+		*end = hi;
+	}
+
+	if (*end <= *start || *end - *start < MRELEASEMIN) {
+		*start = *end = 0;
+	}
+#endif
+}
+
 /*
  * The actual free() implementation.
  */
@@ -457,6 +510,7 @@ void
 free(void *x)
 {
 	struct mheader *mh, *mhnext, *mhprev;
+	uintptr_t data, dataend, relstart, relend;
 
 	if (x==NULL) {
 		/* safest practice */
@@ -491,9 +545,8 @@ free(void *x)
 
 	/* mark it free */
 	mh->mh_inuse = 0;
-
-	/* wipe it */
-	__malloc_deadbeef(M_DATA(mh), M_SIZE(mh));
+	data = (uintptr_t)M_DATA(mh);
+	dataend = data + M_SIZE(mh);
 
 	/* Try merging with the block above (but not if we're at the top) */
 	mhnext = M_NEXT(mh);
@@ -505,6 +558,31 @@ free(void *x)
 	if (mh != (struct mheader *)__heapbase) {
 		mhprev = M_PREV(mh);
 		__malloc_trymerge(mhprev, mh);
+		if (!mhprev->mh_inuse) {
+			mh = mhprev;
+		}
+	}
+
+	/*
+	 * Wipe what we freed, except the pages about to be given back
+	 * (writing them would only bring them in again).
+	 */
+	__malloc_releaserange(mh, data, dataend, &relstart, &relend);
+	if (relstart == relend) {
+		__malloc_deadbeef((void *)data, dataend - data);
+	}
+	else {
+		if (data < relstart) {
+			__malloc_deadbeef((void *)data,
+					  (relstart < dataend ? relstart : dataend) - data);
+		}
+		if (dataend > relend) {
+			uintptr_t from = (data > relend) ? data : relend;
+			__malloc_deadbeef((void *)from, dataend - from);
+		}
+#ifndef HOST
+		madvise((void *)relstart, relend - relstart, MADV_DONTNEED);
+#endif
 	}
 
 #ifdef MALLOCDEBUG